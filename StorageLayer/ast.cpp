@@ -1,23 +1,74 @@
 #include "ast.h"
-#include "json.hpp"
+#include <protobuf/pg_query.pb-c.h>
+#include <stdexcept>
+#include <algorithm>
 
-CreateTableStatement parse_create_table_json(const nlohmann::json& json) {
+// Text of a String node (identifiers, operator and function names)
+static std::string string_node(const PgQuery__Node* node) {
+	if (node == nullptr || node->node_case != PG_QUERY__NODE__NODE_STRING) {
+		throw std::runtime_error("Expected a name");
+	}
+	return node->string->sval;
+}
+
+// protobuf-c leaves unset string fields empty instead of null
+static bool has_text(const char* text) {
+	return text != nullptr && *text != '\0';
+}
+
+std::string parse_value_node(const PgQuery__Node* node) {
+	if (node != nullptr && node->node_case == PG_QUERY__NODE__NODE_PARAM_REF) {
+		return "$" + std::to_string(node->param_ref->number); // bound later by bind_parameters
+	}
+
+	if (node == nullptr || node->node_case != PG_QUERY__NODE__NODE_A_CONST) {
+		throw std::runtime_error("Only constant values are supported");
+	}
+
+	const PgQuery__AConst* aconst = node->a_const;
+
+	if (aconst->val_case == PG_QUERY__A__CONST__VAL_IVAL) {
+		return std::to_string(aconst->ival->ival);
+	}
+	else if (aconst->val_case == PG_QUERY__A__CONST__VAL_SVAL) {
+		return aconst->sval->sval;
+	}
+	throw std::runtime_error("Only integer and string constants are supported");
+}
+
+int parse_param_number(const PgQuery__Node* node) {
+	if (node != nullptr && node->node_case == PG_QUERY__NODE__NODE_PARAM_REF) {
+		return node->param_ref->number;
+	}
+	return 0;
+}
+
+CreateTableStatement parse_create_table_stmt(const PgQuery__CreateStmt& node) {
 	CreateTableStatement stmt;
-	stmt.table_name = json.at("relation").at("relname").get<std::string>();
+	stmt.table_name = node.relation->relname;
 
-	for (auto& column : json.at("tableElts")) {
-		auto& column_def = column.at("ColumnDef");
-		std::string column_name = column_def.at("colname").get<std::string>();
+	for (size_t i = 0; i < node.n_table_elts; i++) {
+		const PgQuery__Node* element = node.table_elts[i];
+		if (element->node_case != PG_QUERY__NODE__NODE_COLUMN_DEF) {
+			throw std::runtime_error("Only column definitions are supported");
+		}
 
-		auto typeName = column_def.at("typeName");
+		const PgQuery__ColumnDef* column_def = element->column_def;
+		std::string column_name = column_def->colname;
 
-		std::string type = typeName.at("names").at(1).at("String").at("sval").get<std::string>();
+		const PgQuery__TypeName* type_name = column_def->type_name;
+
+		// built-in types are qualified with pg_catalog
+		std::string type = string_node(type_name->names[type_name->n_names - 1]);
 
 		if (type == "int4") {
 			stmt.columns.emplace_back(column_name, "INT");
 		}
 		else if (type == "varchar") {
-			int len = typeName.value("typmods", nlohmann::json::array()).at(0).at("A_Const").at("ival").at("ival").get<int>();
+			if (type_name->n_typmods == 0) {
+				throw std::runtime_error("VARCHAR requires a length");
+			}
+			int len = std::stoi(parse_value_node(type_name->typmods[0]));
 			stmt.columns.emplace_back(column_name, "VARCHAR(" + std::to_string(len) + ")");
 		}
 		else {
@@ -28,59 +79,277 @@ CreateTableStatement parse_create_table_json(const nlohmann::json& json) {
 	return stmt;
 }
 
-InsertStatement parse_insert_json(const nlohmann::json& json) {
+InsertStatement parse_insert_stmt(const PgQuery__InsertStmt& node) {
 	InsertStatement stmt;
-	stmt.table_name = json.at("relation").at("relname").get<std::string>();
-	
-	auto& valuesLists = json.at("selectStmt").at("SelectStmt").at("valuesLists");
+	stmt.table_name = node.relation->relname;
 
-	if (!valuesLists.empty()) {
-		auto items = valuesLists.at(0).at("List").at("items");
+	if (node.select_stmt == nullptr || node.select_stmt->node_case != PG_QUERY__NODE__NODE_SELECT_STMT) {
+		throw std::runtime_error("INSERT requires a VALUES list");
+	}
 
-		for (auto& item : items) {
-			auto& aconst = item.at("A_Const");
+	const PgQuery__SelectStmt* values_stmt = node.select_stmt->select_stmt;
 
-			if (aconst.contains("ival")) {
-				int value = aconst.at("ival").at("ival").get<int>();
+	for (size_t i = 0; i < values_stmt->n_values_lists; i++) {
+		const PgQuery__List* values_list = values_stmt->values_lists[i]->list;
+		std::vector<std::string> values;
+		std::vector<int> param_numbers;
 
-				stmt.values.push_back(std::to_string(value));
-			}
-			else if (aconst.contains("sval")) {
-				std::string value = aconst.at("sval").at("sval").get<std::string>();
-				stmt.values.push_back(value);
-			}
-			else {
-				stmt.values.push_back(aconst.dump());
-			}
+		for (size_t j = 0; j < values_list->n_items; j++) {
+			values.push_back(parse_value_node(values_list->items[j]));
+			param_numbers.push_back(parse_param_number(values_list->items[j]));
 		}
+
+		stmt.rows.push_back(std::move(values));
+		stmt.param_numbers.push_back(std::move(param_numbers));
+	}
+
+	if (stmt.rows.empty()) {
+		throw std::runtime_error("INSERT requires a VALUES list");
 	}
 
 	return stmt;
 }
 
-SelectStatement parse_select_json(const nlohmann::json& json) {
+// Name of a referenced column, kept as "table.column" when the query joins tables
+static std::string column_ref_name(const PgQuery__Node* node, bool qualified) {
+	if (node == nullptr || node->node_case != PG_QUERY__NODE__NODE_COLUMN_REF) {
+		throw std::runtime_error("Expected a column reference");
+	}
+
+	const PgQuery__ColumnRef* column_ref = node->column_ref;
+
+	if (!qualified) {
+		return string_node(column_ref->fields[column_ref->n_fields - 1]);
+	}
+
+	std::string name;
+	for (size_t i = 0; i < column_ref->n_fields; i++) {
+		if (!name.empty()) {
+			name += ".";
+		}
+		name += string_node(column_ref->fields[i]);
+	}
+	return name;
+}
+
+// Operator with its operands swapped, value < column is column > value
+static std::string mirror_operator(const std::string& op) {
+	if (op == "<") {
+		return ">";
+	}
+	if (op == ">") {
+		return "<";
+	}
+	if (op == "<=") {
+		return ">=";
+	}
+	if (op == ">=") {
+		return "<=";
+	}
+	return op;
+}
+
+// Constant or parameter items of an IN list or BETWEEN bounds
+static void parse_value_list(const PgQuery__Node* node, Expr& expr) {
+	if (node == nullptr || node->node_case != PG_QUERY__NODE__NODE_LIST) {
+		throw std::runtime_error("Expected a list of values");
+	}
+
+	for (size_t i = 0; i < node->list->n_items; i++) {
+		expr.values.push_back(parse_value_node(node->list->items[i]));
+		expr.param_numbers.push_back(parse_param_number(node->list->items[i]));
+	}
+}
+
+// WHERE expression with AND/OR/NOT over column predicates
+static Expr parse_expr_node(const PgQuery__Node* node, bool qualified) {
+	Expr expr;
+
+	if (node->node_case == PG_QUERY__NODE__NODE_BOOL_EXPR) {
+		const PgQuery__BoolExpr* bool_expr = node->bool_expr;
+
+		if (bool_expr->boolop == PG_QUERY__BOOL_EXPR_TYPE__AND_EXPR) {
+			expr.type = "and";
+		}
+		else if (bool_expr->boolop == PG_QUERY__BOOL_EXPR_TYPE__OR_EXPR) {
+			expr.type = "or";
+		}
+		else {
+			expr.type = "not";
+		}
+
+		for (size_t i = 0; i < bool_expr->n_args; i++) {
+			expr.children.push_back(parse_expr_node(bool_expr->args[i], qualified));
+		}
+		return expr;
+	}
+
+	if (node->node_case == PG_QUERY__NODE__NODE_NULL_TEST) {
+		expr.type = "is_null";
+		expr.column = column_ref_name(node->null_test->arg, qualified);
+		expr.negated = node->null_test->nulltesttype == PG_QUERY__NULL_TEST_TYPE__IS_NOT_NULL;
+		return expr;
+	}
+
+	if (node->node_case != PG_QUERY__NODE__NODE_A_EXPR) {
+		throw std::runtime_error("Unsupported WHERE expression");
+	}
+
+	const PgQuery__AExpr* aexpr = node->a_expr;
+	std::string op = string_node(aexpr->name[0]);
+
+	switch (aexpr->kind) {
+	case PG_QUERY__A__EXPR__KIND__AEXPR_OP: {
+		const PgQuery__Node* column = aexpr->lexpr;
+		const PgQuery__Node* value = aexpr->rexpr;
+
+		if (column != nullptr && column->node_case != PG_QUERY__NODE__NODE_COLUMN_REF &&
+			value != nullptr && value->node_case == PG_QUERY__NODE__NODE_COLUMN_REF) {
+			std::swap(column, value);
+			op = mirror_operator(op);
+		}
+
+		expr.type = "compare";
+		expr.column = column_ref_name(column, qualified);
+		expr.op = op == "<>" ? "!=" : op;
+		expr.values.push_back(parse_value_node(value));
+		expr.param_numbers.push_back(parse_param_number(value));
+		break;
+	}
+	case PG_QUERY__A__EXPR__KIND__AEXPR_IN:
+		expr.type = "in";
+		expr.column = column_ref_name(aexpr->lexpr, qualified);
+		parse_value_list(aexpr->rexpr, expr);
+		expr.negated = op == "<>"; // NOT IN
+		break;
+	case PG_QUERY__A__EXPR__KIND__AEXPR_BETWEEN:
+	case PG_QUERY__A__EXPR__KIND__AEXPR_NOT_BETWEEN:
+		expr.type = "between";
+		expr.column = column_ref_name(aexpr->lexpr, qualified);
+		parse_value_list(aexpr->rexpr, expr);
+		expr.negated = aexpr->kind == PG_QUERY__A__EXPR__KIND__AEXPR_NOT_BETWEEN;
+		break;
+	default:
+		throw std::runtime_error("Unsupported WHERE operator: " + op);
+	}
+
+	return expr;
+}
+
+static JoinClause parse_join_node(const PgQuery__JoinExpr& join_expr, std::string& left_table) {
+	JoinClause join;
+
+	if (join_expr.larg->node_case != PG_QUERY__NODE__NODE_RANGE_VAR || join_expr.rarg->node_case != PG_QUERY__NODE__NODE_RANGE_VAR) {
+		throw std::runtime_error("Only joins of two tables are supported");
+	}
+
+	const PgQuery__RangeVar* larg = join_expr.larg->range_var;
+	const PgQuery__RangeVar* rarg = join_expr.rarg->range_var;
+
+	left_table = larg->relname;
+	join.table_name = rarg->relname;
+
+	if (larg->alias != nullptr) {
+		join.left_alias = larg->alias->aliasname;
+	}
+	if (rarg->alias != nullptr) {
+		join.right_alias = rarg->alias->aliasname;
+	}
+
+	if (join_expr.jointype == PG_QUERY__JOIN_TYPE__JOIN_INNER) {
+		join.type = "inner";
+	}
+	else if (join_expr.jointype == PG_QUERY__JOIN_TYPE__JOIN_LEFT) {
+		join.type = "left";
+	}
+	else {
+		throw std::runtime_error("Unsupported join type");
+	}
+
+	if (join_expr.quals == nullptr || join_expr.quals->node_case != PG_QUERY__NODE__NODE_A_EXPR) {
+		throw std::runtime_error("JOIN requires an ON column = column condition");
+	}
+
+	const PgQuery__AExpr* quals = join_expr.quals->a_expr;
+	if (string_node(quals->name[0]) != "=") {
+		throw std::runtime_error("Only equi-joins are supported");
+	}
+
+	join.left_column = column_ref_name(quals->lexpr, true);
+	join.right_column = column_ref_name(quals->rexpr, true);
+
+	return join;
+}
+
+SelectStatement parse_select_stmt(const PgQuery__SelectStmt& node) {
 	SelectStatement stmt;
 
-	stmt.table_name = json.at("fromClause").at(0).at("RangeVar").at("relname");
+	if (node.n_from_clause == 0) {
+		throw std::runtime_error("SELECT requires a FROM clause");
+	}
+
+	const PgQuery__Node* from = node.from_clause[0];
+
+	if (from->node_case == PG_QUERY__NODE__NODE_JOIN_EXPR) {
+		stmt.join = parse_join_node(*from->join_expr, stmt.table_name);
+	}
+	else if (from->node_case == PG_QUERY__NODE__NODE_RANGE_VAR) {
+		stmt.table_name = from->range_var->relname;
+	}
+	else {
+		throw std::runtime_error("Unsupported FROM clause");
+	}
+
+	bool qualified = stmt.join.has_value();
 
 	bool star = false;
 
 	//projection
-	for (auto& target : json.at("targetList")) {
-		auto& res_target = target.at("ResTarget").at("val");
-		if (res_target.contains("ColumnRef")) {
-			auto& fields = res_target.at("ColumnRef").at("fields");
+	for (size_t i = 0; i < node.n_target_list; i++) {
+		const PgQuery__ResTarget* res_target = node.target_list[i]->res_target;
+		const PgQuery__Node* val = res_target->val;
 
-			if (fields.at(0).contains("A_Star")) {
+		if (val->node_case == PG_QUERY__NODE__NODE_COLUMN_REF) {
+			const PgQuery__ColumnRef* column_ref = val->column_ref;
+
+			if (column_ref->fields[0]->node_case == PG_QUERY__NODE__NODE_A_STAR) {
 				star = true;
 				break;
 			}
 
-			for (auto& field: fields) {
-				if (field.contains("String")) {
-					stmt.columns.push_back(field.at("String").at("sval"));
+			if (column_ref->fields[column_ref->n_fields - 1]->node_case == PG_QUERY__NODE__NODE_A_STAR) {
+				throw std::runtime_error("Qualified * is not supported");
+			}
+
+			stmt.columns.push_back(column_ref_name(val, qualified));
+		}
+		else if (val->node_case == PG_QUERY__NODE__NODE_FUNC_CALL) {
+			const PgQuery__FuncCall* func = val->func_call;
+
+			AggregateExpr agg;
+			agg.function = string_node(func->funcname[func->n_funcname - 1]);
+
+			if (agg.function != "count" && agg.function != "sum" && agg.function != "min" &&
+				agg.function != "max" && agg.function != "avg") {
+				throw std::runtime_error("Unsupported function: " + agg.function);
+			}
+
+			if (!func->agg_star) {
+				if (func->n_args != 1) {
+					throw std::runtime_error("Aggregate " + agg.function + " expects exactly one argument");
 				}
+				agg.column = column_ref_name(func->args[0], false);
+			}
+
+			if (has_text(res_target->name)) {
+				agg.label = res_target->name;
+			}
+			else {
+				agg.label = agg.function + "(" + (agg.column.empty() ? "*" : agg.column) + ")";
 			}
+
+			stmt.columns.push_back(agg.label);
+			stmt.aggregates.push_back(agg);
 		}
 	}
 
@@ -88,35 +357,189 @@ SelectStatement parse_select_json(const nlohmann::json& json) {
 		stmt.columns.clear();
 	}
 
-	// WHERE
+	// GROUP BY
 
-	if (json.contains("whereClause")) {
-		auto& where_clause = json.at("whereClause").at("A_Expr");
+	for (size_t i = 0; i < node.n_group_clause; i++) {
+		stmt.group_by.push_back(column_ref_name(node.group_clause[i], false));
+	}
 
-		stmt.where_column = where_clause.at("lexpr").at("ColumnRef").at("fields").at(0).at("String").at("sval");
+	// WHERE
 
-		stmt.where_operator = where_clause.at("name").at(0).at("String").at("sval");
-		
-		auto& rc = where_clause.at("rexpr").at("A_Const");
-		if (rc.contains("ival"))
-			stmt.where_value = std::to_string(rc.at("ival").at("ival").get<int>());
-		else
-			stmt.where_value = rc.at("sval").at("sval").get<std::string>();
+	if (node.where_clause != nullptr) {
+		stmt.where = parse_expr_node(node.where_clause, qualified);
 	}
 
 	// ORDER BY
 
-	if (json.contains("sortClause") && !stmt.columns.empty()) {
-		auto& sort_clause = json.at("sortClause").at(0).at("SortBy");
-		stmt.order_by_column = sort_clause.at("node").at("ColumnRef").at("fields").at(0).at("String").at("sval");
+	if (node.n_sort_clause > 0 && !stmt.columns.empty()) {
+		const PgQuery__SortBy* sort_clause = node.sort_clause[0]->sort_by;
+		stmt.order_by_column = column_ref_name(sort_clause->node, qualified);
 	}
 
 	// LIMIT
 
-	if (json.contains("limitCount")) {
-		auto& limit_clause = json.at("limitCount").at("A_Const");
-		stmt.limit = limit_clause.at("ival").at("ival").get<int>();
+	if (node.limit_count != nullptr) {
+		stmt.limit = std::stoi(parse_value_node(node.limit_count));
 	}
 	
 	return stmt;
-}
\ No newline at end of file
+}
+
+UpdateStatement parse_update_stmt(const PgQuery__UpdateStmt& node) {
+	UpdateStatement stmt;
+	stmt.table_name = node.relation->relname;
+
+	for (size_t i = 0; i < node.n_target_list; i++) {
+		const PgQuery__ResTarget* res_target = node.target_list[i]->res_target;
+		std::string column = res_target->name;
+
+		stmt.assignments.emplace_back(column, parse_value_node(res_target->val));
+		stmt.param_numbers.push_back(parse_param_number(res_target->val));
+	}
+
+	if (node.where_clause != nullptr) {
+		stmt.where = parse_expr_node(node.where_clause, false);
+	}
+
+	return stmt;
+}
+
+DeleteStatement parse_delete_stmt(const PgQuery__DeleteStmt& node) {
+	DeleteStatement stmt;
+	stmt.table_name = node.relation->relname;
+
+	if (node.where_clause != nullptr) {
+		stmt.where = parse_expr_node(node.where_clause, false);
+	}
+
+	return stmt;
+}
+
+ExecuteStatement parse_execute_stmt(const PgQuery__ExecuteStmt& node) {
+	ExecuteStatement stmt;
+	stmt.name = node.name;
+
+	for (size_t i = 0; i < node.n_params; i++) {
+		stmt.params.push_back(parse_value_node(node.params[i]));
+		stmt.param_numbers.push_back(parse_param_number(node.params[i]));
+	}
+
+	return stmt;
+}
+
+AnalyzeStatement parse_analyze_stmt(const PgQuery__VacuumStmt& node) {
+	if (node.is_vacuumcmd) {
+		throw std::runtime_error("VACUUM is not supported, tables are compacted automatically");
+	}
+
+	AnalyzeStatement stmt;
+
+	for (size_t i = 0; i < node.n_rels; i++) {
+		const PgQuery__Node* rel = node.rels[i];
+		if (rel->node_case != PG_QUERY__NODE__NODE_VACUUM_RELATION || rel->vacuum_relation->relation == nullptr) {
+			throw std::runtime_error("ANALYZE expects table names");
+		}
+		stmt.tables.push_back(rel->vacuum_relation->relation->relname);
+	}
+
+	return stmt;
+}
+
+ExplainStatement parse_explain_stmt(const PgQuery__ExplainStmt& node) {
+	ExplainStatement stmt;
+
+	for (size_t i = 0; i < node.n_options; i++) {
+		const PgQuery__Node* option = node.options[i];
+		if (option->node_case == PG_QUERY__NODE__NODE_DEF_ELEM && std::string(option->def_elem->defname) == "analyze") {
+			stmt.analyze = true;
+		}
+	}
+
+	const PgQuery__Node* query = node.query;
+	if (query == nullptr) {
+		throw std::runtime_error("EXPLAIN expects a statement");
+	}
+
+	switch (query->node_case) {
+	case PG_QUERY__NODE__NODE_SELECT_STMT:
+		stmt.statement = parse_select_stmt(*query->select_stmt);
+		break;
+	case PG_QUERY__NODE__NODE_DELETE_STMT:
+		stmt.statement = parse_delete_stmt(*query->delete_stmt);
+		break;
+	case PG_QUERY__NODE__NODE_UPDATE_STMT:
+		stmt.statement = parse_update_stmt(*query->update_stmt);
+		break;
+	default:
+		throw std::runtime_error("EXPLAIN supports SELECT, UPDATE and DELETE");
+	}
+
+	return stmt;
+}
+
+// Replaces a value that was the $n parameter with the n-th parameter, it is a constant afterwards
+static void bind_value(std::string& value, int& param_number, const std::vector<std::string>& params) {
+	if (param_number == 0) {
+		return; // constants are kept even when they look like "$n"
+	}
+
+	if (param_number < 0 || (size_t)param_number > params.size()) {
+		throw std::runtime_error("No value supplied for parameter $" + std::to_string(param_number));
+	}
+	value = params[param_number - 1];
+	param_number = 0;
+}
+
+static void bind_values(std::vector<std::string>& values, std::vector<int>& param_numbers, const std::vector<std::string>& params) {
+	for (size_t i = 0; i < values.size() && i < param_numbers.size(); i++) {
+		bind_value(values[i], param_numbers[i], params);
+	}
+}
+
+static void bind_expr(Expr& expr, const std::vector<std::string>& params) {
+	bind_values(expr.values, expr.param_numbers, params);
+
+	for (auto& child : expr.children) {
+		bind_expr(child, params);
+	}
+}
+
+static void bind_where(std::optional<Expr>& where, const std::vector<std::string>& params) {
+	if (where) {
+		bind_expr(*where, params);
+	}
+}
+
+template <typename T>
+static void bind_statement(T& stmt, const std::vector<std::string>& params) {
+	if constexpr (std::is_same_v<T, InsertStatement>) {
+		for (size_t i = 0; i < stmt.rows.size() && i < stmt.param_numbers.size(); i++) {
+			bind_values(stmt.rows[i], stmt.param_numbers[i], params);
+		}
+	}
+	else if constexpr (std::is_same_v<T, SelectStatement>) {
+		bind_where(stmt.where, params);
+	}
+	else if constexpr (std::is_same_v<T, DeleteStatement>) {
+		bind_where(stmt.where, params);
+	}
+	else if constexpr (std::is_same_v<T, UpdateStatement>) {
+		for (size_t i = 0; i < stmt.assignments.size() && i < stmt.param_numbers.size(); i++) {
+			bind_value(stmt.assignments[i].second, stmt.param_numbers[i], params);
+		}
+		bind_where(stmt.where, params);
+	}
+	else if constexpr (std::is_same_v<T, CTASStatement>) {
+		bind_where(stmt.selectStmt.where, params);
+	}
+	else if constexpr (std::is_same_v<T, ExecuteStatement>) {
+		bind_values(stmt.params, stmt.param_numbers, params);
+	}
+	else if constexpr (std::is_same_v<T, ExplainStatement>) {
+		std::visit([&](auto& inner) { bind_statement(inner, params); }, stmt.statement);
+	}
+}
+
+void bind_parameters(AST& ast, const std::vector<std::string>& params) {
+	std::visit([&](auto& stmt) { bind_statement(stmt, params); }, ast);
+}
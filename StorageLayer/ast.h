@@ -2,7 +2,18 @@
 #include <string>
 #include <vector>
 #include <variant>
-#include "json.hpp"
+#include <optional>
+
+// pg_query protobuf parse tree nodes, defined in protobuf/pg_query.pb-c.h
+struct PgQuery__Node;
+struct PgQuery__CreateStmt;
+struct PgQuery__InsertStmt;
+struct PgQuery__SelectStmt;
+struct PgQuery__UpdateStmt;
+struct PgQuery__DeleteStmt;
+struct PgQuery__ExecuteStmt;
+struct PgQuery__VacuumStmt;
+struct PgQuery__ExplainStmt;
 
 struct CreateTableStatement {
 	std::string table_name;
@@ -11,15 +22,43 @@ struct CreateTableStatement {
 
 struct InsertStatement {
 	std::string table_name;
-	std::vector<std::string> values; // Values to insert, can be strings or numbers
+	std::vector<std::vector<std::string>> rows; // One list of values per VALUES tuple, can be strings or numbers
+	std::vector<std::vector<int>> param_numbers; // n of every $n parameter in rows, 0 for constants
+};
+
+// Node of a WHERE expression tree
+struct Expr {
+	std::string type; // "and", "or", "not", "compare", "in", "between" or "is_null"
+	std::string column; // Column of a predicate, may be qualified as "table.column"
+	std::string op; // Operator of "compare" ('=', '!=', '<', '<=', '>', '>=')
+	std::vector<std::string> values; // One value for "compare", the list for "in", low and high for "between"
+	std::vector<int> param_numbers; // n of every $n parameter in values, 0 for constants
+	bool negated = false; // NOT IN, NOT BETWEEN, IS NOT NULL
+	std::vector<Expr> children; // Operands of "and", "or" and "not"
+};
+
+struct AggregateExpr {
+	std::string function; // count, sum, min, max or avg
+	std::string column; // Aggregated column, empty for COUNT(*)
+	std::string label; // Output column name (alias or e.g. "sum(salary)")
+};
+
+struct JoinClause {
+	std::string table_name; // Joined (right) table
+	std::string type; // "inner" or "left"
+	std::string left_column; // Column references of the ON a = b condition, may be qualified as "table.column"
+	std::string right_column;
+	std::optional<std::string> left_alias; // Aliases of the FROM table and the joined table
+	std::optional<std::string> right_alias;
 };
 
 struct SelectStatement {
 	std::string table_name;
+	std::optional<JoinClause> join; // Optional JOIN with a second table
 	std::vector<std::string> columns; // Columns to select, empty means all columns
-	std::optional<std::string> where_column; // Optional WHERE clause column
-	std::optional<std::string> where_operator; // Optional WHERE clause operator (e.g., '=', '>', '<', etc.)
-	std::optional<std::string> where_value; // Optional WHERE clause value
+	std::vector<AggregateExpr> aggregates; // Aggregate functions, their labels are also listed in columns
+	std::vector<std::string> group_by; // GROUP BY columns
+	std::optional<Expr> where; // Optional WHERE clause
 	std::optional<std::string> order_by_column; // Optional ORDER BY column
 	std::optional<size_t> limit; // Optional LIMIT clause
 };
@@ -27,9 +66,15 @@ struct SelectStatement {
 struct DeleteStatement
 {
 	std::string table_name;
-	std::optional<std::string> where_column;
-	std::optional<std::string> where_operator;
-	std::optional<std::string> where_value;
+	std::optional<Expr> where;
+};
+
+struct UpdateStatement
+{
+	std::string table_name;
+	std::vector<std::pair<std::string, std::string>> assignments; // SET column = value
+	std::vector<int> param_numbers; // n of every $n parameter assigned, 0 for constants
+	std::optional<Expr> where;
 };
 
 struct CTASStatement
@@ -38,14 +83,57 @@ struct CTASStatement
 	SelectStatement selectStmt;
 };
 
+struct PrepareStatement
+{
+	std::string name;
+	std::string query; // SQL text of the prepared statement with $1, $2, ... parameters
+};
+
+struct ExecuteStatement
+{
+	std::string name;
+	std::vector<std::string> params;
+	std::vector<int> param_numbers; // n of every $n parameter in params, 0 for constants
+};
+
+struct AnalyzeStatement
+{
+	std::vector<std::string> tables; // Tables to analyze, empty means all tables
+};
+
+struct ExplainStatement
+{
+	bool analyze = false; // EXPLAIN ANALYZE runs the statement and reports what each operator did
+	std::variant<SelectStatement, DeleteStatement, UpdateStatement> statement;
+};
+
 using AST = std::variant<CreateTableStatement,
 	InsertStatement,
 	SelectStatement,
 	DeleteStatement,
-	CTASStatement>;
+	UpdateStatement,
+	CTASStatement,
+	PrepareStatement,
+	ExecuteStatement,
+	AnalyzeStatement,
+	ExplainStatement>;
+
+
+CreateTableStatement parse_create_table_stmt(const PgQuery__CreateStmt& node);
+InsertStatement parse_insert_stmt(const PgQuery__InsertStmt& node);
+SelectStatement parse_select_stmt(const PgQuery__SelectStmt& node);
+UpdateStatement parse_update_stmt(const PgQuery__UpdateStmt& node);
+DeleteStatement parse_delete_stmt(const PgQuery__DeleteStmt& node);
+ExecuteStatement parse_execute_stmt(const PgQuery__ExecuteStmt& node);
+AnalyzeStatement parse_analyze_stmt(const PgQuery__VacuumStmt& node);
+ExplainStatement parse_explain_stmt(const PgQuery__ExplainStmt& node);
+
+// Constant or "$n" parameter value of an expression node
+std::string parse_value_node(const PgQuery__Node* node);
 
+// $n number of a parameter node, 0 for constants
+int parse_param_number(const PgQuery__Node* node);
 
-CreateTableStatement parse_create_table_json(const nlohmann::json& json);
-InsertStatement parse_insert_json(const nlohmann::json& json);
-SelectStatement parse_select_json(const nlohmann::json& json);
+// Replace the $n parameters in the statement with the given values, constants that look like "$n" are kept
+void bind_parameters(AST& ast, const std::vector<std::string>& params);
 
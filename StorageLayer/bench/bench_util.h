@@ -0,0 +1,102 @@
+#pragma once
+// Helpers shared by the benchmark executables
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "table_schema.h"
+
+using BenchClock = std::chrono::steady_clock;
+
+inline double elapsed_us(BenchClock::time_point start) {
+	return std::chrono::duration<double, std::micro>(BenchClock::now() - start).count();
+}
+
+/**
+ * Zipfian ranks in [0, n) with rank 0 the most frequent (Gray et al., "Quickly generating
+ * billion-record synthetic databases", the generator YCSB uses). Setup is O(n), every draw O(1).
+ */
+class ZipfianGenerator {
+public:
+	explicit ZipfianGenerator(size_t n, double theta = 0.99) : n(std::max<size_t>(n, 1)), theta(theta) {
+		for (size_t i = 1; i <= this->n; i++) {
+			zetan += 1.0 / std::pow((double)i, theta);
+		}
+		double zeta2 = 1.0 + std::pow(0.5, theta);
+		alpha = 1.0 / (1.0 - theta);
+		eta = (1.0 - std::pow(2.0 / this->n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+	}
+
+	template <typename Random>
+	size_t next(Random& random) {
+		double u = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+		double uz = u * zetan;
+
+		if (uz < 1.0) {
+			return 0;
+		}
+		if (uz < 1.0 + std::pow(0.5, theta)) {
+			return std::min<size_t>(1, n - 1);
+		}
+		return std::min(n - 1, (size_t)(n * std::pow(eta * u - eta + 1.0, alpha)));
+	}
+
+	size_t size() const {
+		return n;
+	}
+
+private:
+	size_t n;
+	double theta;
+	double zetan = 0;
+	double alpha = 0;
+	double eta = 0;
+};
+
+// Spreads zipfian ranks over the key space, so the hot keys are not all on the first pages
+inline size_t scramble_key(size_t rank, size_t n) {
+	uint64_t hash = 14695981039346656037ull;
+	for (int i = 0; i < 8; i++) {
+		hash ^= (rank >> (i * 8)) & 0xFF;
+		hash *= 1099511628211ull;
+	}
+	return hash % n;
+}
+
+// Benchmark table: id INT (indexed), val INT and a VARCHAR payload sized so a packed record takes record_size bytes
+inline TableSchema bench_schema(size_t record_size) {
+	// INT + INT + 2 byte VARCHAR length
+	int payload = record_size > 11 ? (int)record_size - 10 : 1;
+
+	TableSchema schema;
+	schema.columns = { { "id", DataType::INT, sizeof(int) }, { "val", DataType::INT, sizeof(int) }, { "payload", DataType::VARCHAR, payload } };
+	return schema;
+}
+
+inline std::vector<std::string> bench_row(const TableSchema& schema, size_t key, size_t val) {
+	std::string payload(schema.columns[2].length, (char)('a' + key % 26));
+	return { std::to_string(key), std::to_string(val), payload };
+}
+
+// p in [0, 1] of sorted values
+inline double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty()) {
+		return 0;
+	}
+	size_t rank = (size_t)std::ceil(p * sorted.size());
+	return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+inline std::string json_escape(const std::string& text) {
+	std::string escaped;
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped;
+}
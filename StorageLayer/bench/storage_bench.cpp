@@ -0,0 +1,388 @@
+// Micro-benchmarks of the storage layer, results are written as JSON.
+//
+//   storage_bench [--rows N] [--record-size BYTES] [--distribution uniform|sequential|zipf]
+//                 [--ops N] [--write-ops N] [--seed N] [--only name,...] [--dir PATH] [--output FILE]
+//
+// The table has the columns id INT (indexed), val INT and payload VARCHAR, sized so a packed
+// record takes --record-size bytes. Point operations pick their keys from --distribution.
+#include "file_storage_layer.h"
+#include "query_executor.h"
+#include "record_codec.h"
+#include "bench_util.h"
+#ifdef STORAGE_BENCH_SQL
+#include "parser.h"
+#include "plan_cache.h"
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct BenchConfig {
+	size_t rows = 100000;
+	size_t record_size = 64;
+	std::string distribution = "uniform";
+	size_t ops = 10000; // operations of the read benchmarks
+	size_t write_ops = 100; // operations of insert, update and delete_record, every one of them persists the index
+	uint64_t seed = 42;
+	std::vector<std::string> only;
+	std::string dir;
+	std::string output;
+};
+
+struct BenchResult {
+	std::string name;
+	size_t ops = 0;
+	size_t items = 0; // records processed, e.g. rows returned by a scan
+	double total_ms = 0;
+	std::vector<double> latencies_us; // of every operation
+	StorageStats io; // storage counters of the timed operations
+};
+
+// Key generator: uniform, sequential (0, 1, 2, ...) or zipfian with theta 0.99 over [0, n)
+class KeyChooser {
+public:
+	KeyChooser(const std::string& distribution, size_t n, uint64_t seed) : distribution(distribution), n(n), random(seed), zipfian(distribution == "zipf" ? n : 1) {
+		if (distribution != "uniform" && distribution != "sequential" && distribution != "zipf") {
+			throw std::runtime_error("Unknown key distribution: " + distribution);
+		}
+	}
+
+	size_t next() {
+		if (distribution == "sequential") {
+			return next_key++ % n;
+		}
+		if (distribution == "zipf") {
+			return zipfian.next(random);
+		}
+		return std::uniform_int_distribution<size_t>(0, n - 1)(random);
+	}
+
+private:
+	std::string distribution;
+	size_t n;
+	std::mt19937_64 random;
+	ZipfianGenerator zipfian;
+	size_t next_key = 0;
+};
+
+static void write_json(std::ostream& out, const BenchConfig& config, const std::vector<BenchResult>& results) {
+	out << std::fixed << std::setprecision(3);
+	out << "{\n";
+	out << "  \"config\": {\"rows\": " << config.rows << ", \"record_size\": " << config.record_size
+		<< ", \"distribution\": \"" << json_escape(config.distribution) << "\", \"ops\": " << config.ops
+		<< ", \"write_ops\": " << config.write_ops << ", \"seed\": " << config.seed << "},\n";
+	out << "  \"results\": [\n";
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& result = results[i];
+		std::vector<double> sorted = result.latencies_us;
+		std::sort(sorted.begin(), sorted.end());
+
+		double mean = 0;
+		for (double latency : sorted) {
+			mean += latency;
+		}
+		mean = sorted.empty() ? 0 : mean / sorted.size();
+
+		double seconds = result.total_ms / 1000.0;
+		out << "    {\"name\": \"" << json_escape(result.name) << "\", \"ops\": " << result.ops << ", \"items\": " << result.items
+			<< ", \"total_ms\": " << result.total_ms
+			<< ", \"ops_per_sec\": " << (seconds > 0 ? result.ops / seconds : 0)
+			<< ", \"items_per_sec\": " << (seconds > 0 ? result.items / seconds : 0)
+			<< ", \"mean_us\": " << mean
+			<< ", \"p50_us\": " << percentile(sorted, 0.5)
+			<< ", \"p99_us\": " << percentile(sorted, 0.99)
+			<< ", \"max_us\": " << (sorted.empty() ? 0 : sorted.back())
+			<< ", \"io\": {\"pages_read\": " << result.io[StorageCounter::PagesRead]
+			<< ", \"pages_written\": " << result.io[StorageCounter::PagesWritten]
+			<< ", \"bytes_read\": " << result.io[StorageCounter::BytesRead]
+			<< ", \"bytes_written\": " << result.io[StorageCounter::BytesWritten]
+			<< ", \"syscalls\": " << result.io.syscalls()
+			<< ", \"vacuum_runs\": " << result.io[StorageCounter::VacuumRuns]
+			<< ", \"index_saves\": " << result.io[StorageCounter::IndexSaves] << "}}"
+			<< (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	out << "  ]\n}\n";
+}
+
+// Runs op ops times and records the latency of every call, op returns the number of processed items
+static BenchResult measure(const FileStorageLayer& storage, const std::string& name, size_t ops, const std::function<size_t(size_t)>& op) {
+	StorageStats before = storage.counters_snapshot();
+	BenchResult result;
+	result.name = name;
+	result.ops = ops;
+	result.latencies_us.reserve(ops);
+
+	auto start = BenchClock::now();
+	for (size_t i = 0; i < ops; i++) {
+		auto op_start = BenchClock::now();
+		result.items += op(i);
+		result.latencies_us.push_back(elapsed_us(op_start));
+	}
+	result.total_ms = std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+	result.io = storage.counters_snapshot().since(before);
+
+	return result;
+}
+
+static BenchConfig parse_args(int argc, char** argv) {
+	BenchConfig config;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			throw std::runtime_error("Missing value for " + arg);
+		}
+		std::string value = argv[++i];
+
+		if (arg == "--rows") {
+			config.rows = std::stoull(value);
+		}
+		else if (arg == "--record-size") {
+			config.record_size = std::stoull(value);
+		}
+		else if (arg == "--distribution") {
+			config.distribution = value;
+		}
+		else if (arg == "--ops") {
+			config.ops = std::stoull(value);
+		}
+		else if (arg == "--write-ops") {
+			config.write_ops = std::stoull(value);
+		}
+		else if (arg == "--seed") {
+			config.seed = std::stoull(value);
+		}
+		else if (arg == "--only") {
+			std::stringstream names(value);
+			std::string name;
+			while (std::getline(names, name, ',')) {
+				config.only.push_back(name);
+			}
+		}
+		else if (arg == "--dir") {
+			config.dir = value;
+		}
+		else if (arg == "--output") {
+			config.output = value;
+		}
+		else {
+			throw std::runtime_error("Unknown option " + arg);
+		}
+	}
+
+	if (config.rows == 0) {
+		throw std::runtime_error("--rows has to be positive");
+	}
+	return config;
+}
+
+int main(int argc, char** argv) {
+	BenchConfig config;
+	try {
+		config = parse_args(argc, argv);
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 2;
+	}
+
+	auto selected = [&](const std::string& name) {
+		return config.only.empty() || std::find(config.only.begin(), config.only.end(), name) != config.only.end();
+	};
+
+	std::filesystem::path dir = config.dir.empty()
+		? std::filesystem::temp_directory_path() / ("storage_bench_" + std::to_string(BenchClock::now().time_since_epoch().count()))
+		: std::filesystem::path(config.dir);
+	std::filesystem::remove_all(dir);
+
+	// the storage layer reports problems on std::cout, stdout is kept for the JSON results
+	std::streambuf* stdout_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+	std::vector<BenchResult> results;
+	const std::string table = "bench";
+
+	try {
+		FileStorageLayer storage;
+		storage.open(dir.string());
+
+		TableSchema schema = bench_schema(config.record_size);
+		storage.create_table(table, schema);
+		QueryExecutor executor(storage);
+
+		std::vector<std::vector<uint8_t>> records;
+		records.reserve(config.rows);
+		for (size_t key = 0; key < config.rows; key++) {
+			records.push_back(executor.packRecord(schema, bench_row(schema, key, key % 1000)));
+		}
+
+		// the table is always loaded, record IDs by key are kept for the point operations
+		std::vector<int> record_ids;
+		const size_t batch = 10000;
+		results.push_back(measure(storage, "insert_many", (config.rows + batch - 1) / batch, [&](size_t i) {
+			std::vector<std::vector<uint8_t>> chunk(records.begin() + i * batch, records.begin() + std::min(config.rows, (i + 1) * batch));
+			auto ids = storage.insert_many(table, chunk);
+			record_ids.insert(record_ids.end(), ids.begin(), ids.end());
+			return ids.size();
+		}));
+		std::cerr << "loaded " << record_ids.size() << " records into " << storage.page_count(table) << " pages" << std::endl;
+
+		if (selected("get")) {
+			KeyChooser keys(config.distribution, config.rows, config.seed);
+			results.push_back(measure(storage, "get", config.ops, [&](size_t) {
+				return storage.get(table, record_ids[keys.next()]).empty() ? 0 : 1;
+			}));
+		}
+
+		if (selected("find")) {
+			KeyChooser keys(config.distribution, config.rows, config.seed);
+			results.push_back(measure(storage, "find", config.ops, [&](size_t) {
+				return storage.find(table, std::to_string(keys.next())).size();
+			}));
+		}
+
+		if (selected("scan")) {
+			results.push_back(measure(storage, "scan", 3, [&](size_t) {
+				return storage.scan(table).size();
+			}));
+		}
+
+		if (selected("parallel_scan")) {
+			results.push_back(measure(storage, "parallel_scan", 3, [&](size_t) {
+				return storage.parallel_scan(table).size();
+			}));
+		}
+
+		if (selected("pack_record")) {
+			std::vector<std::vector<std::string>> rows;
+			for (size_t i = 0; i < std::min(config.rows, (size_t)1000); i++) {
+				rows.push_back(bench_row(schema, i, i % 1000));
+			}
+			results.push_back(measure(storage, "pack_record", config.ops, [&](size_t i) {
+				return executor.packRecord(schema, rows[i % rows.size()]).empty() ? 0 : 1;
+			}));
+		}
+
+		if (selected("unpack_record")) {
+			results.push_back(measure(storage, "unpack_record", config.ops, [&](size_t i) {
+				return executor.unpackRecord(schema, records[i % records.size()]).size() == schema.columns.size() ? 1 : 0;
+			}));
+		}
+
+#ifdef STORAGE_BENCH_SQL
+		std::vector<std::string> queries = {
+			"SELECT id, payload FROM bench WHERE id = 42",
+			"SELECT val, COUNT(*) FROM bench WHERE id > 100 AND val IN (1, 2, 3) GROUP BY val",
+			"INSERT INTO bench (id, val, payload) VALUES (1, 2, 'abc')",
+			"UPDATE bench SET val = 7 WHERE id BETWEEN 10 AND 20",
+		};
+
+		if (selected("parse_sql")) {
+			results.push_back(measure(storage, "parse_sql", config.ops, [&](size_t i) {
+				parse_sql_to_ast(queries[i % queries.size()]);
+				return 1;
+			}));
+		}
+
+		if (selected("plan_cache_parse")) {
+			PlanCache cache;
+			results.push_back(measure(storage, "plan_cache_parse", config.ops, [&](size_t i) {
+				cache.parse(queries[i % queries.size()]);
+				return 1;
+			}));
+		}
+#endif
+
+		if (selected("update")) {
+			// same size records are rewritten in place, the record IDs stay valid
+			KeyChooser keys(config.distribution, config.rows, config.seed);
+			results.push_back(measure(storage, "update", config.write_ops, [&](size_t i) {
+				size_t key = keys.next();
+				auto row = bench_row(schema, key, key % 1000);
+				row[1] = std::to_string(i);
+				return storage.update(table, record_ids[key], executor.packRecord(schema, row)) ? 1 : 0;
+			}));
+		}
+
+		if (selected("insert")) {
+			results.push_back(measure(storage, "insert", config.write_ops, [&](size_t i) {
+				return storage.insert(table, executor.packRecord(schema, bench_row(schema, config.rows + i, i))) >= 0 ? 1 : 0;
+			}));
+		}
+
+		if (selected("delete_record")) {
+			// deleting compacts the table and renumbers the records, the record ID is looked up by key
+			// in the index first and only the delete itself is timed
+			KeyChooser keys(config.distribution, config.rows, config.seed);
+			std::vector<bool> deleted(config.rows, false);
+
+			BenchResult result;
+			result.name = "delete_record";
+			for (size_t i = 0; i < config.write_ops && i < config.rows; i++) {
+				size_t key = keys.next();
+				for (size_t tries = 0; deleted[key] && tries < config.rows; tries++) {
+					key = (key + 1) % config.rows;
+				}
+				deleted[key] = true;
+
+				int record_id = -1;
+				std::string key_text = std::to_string(key);
+				for (int candidate : storage.find(table, key_text)) {
+					auto record = storage.get(table, candidate);
+					if (!record.empty() && value_to_string(read_column(schema, record, 0)) == key_text) {
+						record_id = candidate;
+						break;
+					}
+				}
+
+				StorageStats before = storage.counters_snapshot();
+				auto start = BenchClock::now();
+				result.items += record_id >= 0 && storage.delete_record(table, record_id) ? 1 : 0;
+				double elapsed = elapsed_us(start);
+
+				StorageStats delta = storage.counters_snapshot().since(before);
+				for (size_t counter = 0; counter < STORAGE_COUNTER_COUNT; counter++) {
+					result.io.values[counter] += delta.values[counter];
+				}
+
+				result.ops++;
+				result.latencies_us.push_back(elapsed);
+				result.total_ms += elapsed / 1000.0;
+			}
+			results.push_back(std::move(result));
+		}
+
+		storage.close();
+	}
+	catch (const std::exception& e) {
+		std::cout.rdbuf(stdout_buffer);
+		std::cerr << "benchmark failed: " << e.what() << std::endl;
+		std::filesystem::remove_all(dir);
+		return 1;
+	}
+
+	std::cout.rdbuf(stdout_buffer);
+	if (config.dir.empty()) {
+		std::filesystem::remove_all(dir);
+	}
+
+	if (config.output.empty()) {
+		write_json(std::cout, config, results);
+	}
+	else {
+		std::ofstream out(config.output);
+		write_json(out, config, results);
+	}
+
+	return 0;
+}
@@ -0,0 +1,396 @@
+// YCSB style workload driver, client threads run a mix of operations against one FileStorageLayer
+// and the throughput and latency percentiles are written as JSON.
+//
+//   ycsb_bench [--workload a|b|c|d|e|f] [--records N] [--ops N] [--threads N] [--record-size BYTES]
+//              [--distribution uniform|zipfian|latest] [--max-scan-length N] [--durability sync|async] [--seed N]
+//              [--dir PATH] [--output FILE]
+//
+// Workloads (Cooper et al., "Benchmarking Cloud Serving Systems with YCSB"):
+//   a  50% read, 50% update, zipfian          d  95% read, 5% insert, latest
+//   b  95% read, 5% update, zipfian           e  95% scan, 5% insert, zipfian
+//   c  100% read, zipfian                     f  50% read, 50% read-modify-write, zipfian
+#include "file_storage_layer.h"
+#include "query_executor.h"
+#include "bench_util.h"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class Operation { Read, Update, Insert, Scan, ReadModifyWrite, Count };
+
+static const char* operation_names[] = { "read", "update", "insert", "scan", "read_modify_write" };
+
+struct Workload {
+	double proportions[(int)Operation::Count] = {};
+	std::string distribution;
+};
+
+struct YcsbConfig {
+	std::string workload = "a";
+	size_t records = 10000;
+	size_t ops = 10000;
+	size_t threads = 4;
+	size_t record_size = 100;
+	std::string distribution; // empty: the distribution of the workload
+	size_t max_scan_length = 100;
+	std::string durability = "sync";
+	uint64_t seed = 42;
+	std::string dir;
+	std::string output;
+};
+
+static Workload make_workload(const std::string& name) {
+	Workload workload;
+	workload.distribution = "zipfian";
+	auto& p = workload.proportions;
+
+	if (name == "a") {
+		p[(int)Operation::Read] = 0.5;
+		p[(int)Operation::Update] = 0.5;
+	}
+	else if (name == "b") {
+		p[(int)Operation::Read] = 0.95;
+		p[(int)Operation::Update] = 0.05;
+	}
+	else if (name == "c") {
+		p[(int)Operation::Read] = 1.0;
+	}
+	else if (name == "d") {
+		p[(int)Operation::Read] = 0.95;
+		p[(int)Operation::Insert] = 0.05;
+		workload.distribution = "latest";
+	}
+	else if (name == "e") {
+		p[(int)Operation::Scan] = 0.95;
+		p[(int)Operation::Insert] = 0.05;
+	}
+	else if (name == "f") {
+		p[(int)Operation::Read] = 0.5;
+		p[(int)Operation::ReadModifyWrite] = 0.5;
+	}
+	else {
+		throw std::runtime_error("Unknown workload: " + name);
+	}
+	return workload;
+}
+
+/**
+ * State shared by the clients. The clients call FileStorageLayer concurrently, a write waits for the latch
+ * of its page; the measured latency includes waiting for it.
+ */
+struct SharedState {
+	FileStorageLayer& storage;
+	QueryExecutor executor;
+	TableSchema schema;
+	std::string table;
+
+	std::shared_mutex keys_mutex; // guards record_ids, an insert holds it exclusively so keys stay in insert order
+	std::vector<int> record_ids; // by key, keys are 0 .. record_ids.size() - 1
+	std::atomic<size_t> key_count{ 0 }; // keys visible to the clients, grows with inserts
+
+	SharedState(FileStorageLayer& storage, const TableSchema& schema, const std::string& table)
+		: storage(storage), executor(storage), schema(schema), table(table) {}
+
+	int record_id(size_t key) {
+		std::shared_lock<std::shared_mutex> lock(keys_mutex);
+		return key < record_ids.size() ? record_ids[key] : -1;
+	}
+};
+
+struct ClientResult {
+	std::vector<double> latencies_us[(int)Operation::Count];
+	size_t failed = 0;
+};
+
+static void run_client(SharedState& state, const YcsbConfig& config, const Workload& workload, size_t ops, uint64_t seed, ClientResult& result) {
+	std::mt19937_64 random(seed);
+	std::discrete_distribution<int> choose_operation(std::begin(workload.proportions), std::end(workload.proportions));
+	ZipfianGenerator zipfian(config.records);
+	std::uniform_int_distribution<size_t> scan_length(1, std::max<size_t>(1, config.max_scan_length));
+
+	auto next_key = [&]() -> size_t {
+		size_t keys = state.key_count.load();
+		if (workload.distribution == "latest") {
+			// the most recently inserted keys are the most popular
+			size_t rank = zipfian.next(random);
+			return rank < keys ? keys - 1 - rank : 0;
+		}
+		if (workload.distribution == "zipfian") {
+			return scramble_key(zipfian.next(random), keys);
+		}
+		return std::uniform_int_distribution<size_t>(0, keys - 1)(random);
+	};
+
+	for (size_t i = 0; i < ops; i++) {
+		auto operation = (Operation)choose_operation(random);
+		size_t key = next_key();
+		bool ok = true;
+
+		auto start = BenchClock::now();
+		switch (operation) {
+		case Operation::Read: {
+			ok = !state.storage.get(state.table, state.record_id(key)).empty();
+			break;
+		}
+		case Operation::Update: {
+			auto record = state.executor.packRecord(state.schema, bench_row(state.schema, key, i));
+			ok = state.storage.update(state.table, state.record_id(key), record);
+			break;
+		}
+		case Operation::ReadModifyWrite: {
+			// not atomic: another client may update the record between the read and the write
+			int record_id = state.record_id(key);
+			auto record = state.storage.get(state.table, record_id);
+			if (record.empty()) {
+				ok = false;
+				break;
+			}
+			auto row = state.executor.unpackRecord(state.schema, record);
+			row[1] = std::to_string(std::stoi(row[1]) + 1);
+			ok = state.storage.update(state.table, record_id, state.executor.packRecord(state.schema, row));
+			break;
+		}
+		case Operation::Insert: {
+			std::unique_lock<std::shared_mutex> lock(state.keys_mutex);
+			size_t new_key = state.record_ids.size();
+			int record_id = state.storage.insert(state.table, state.executor.packRecord(state.schema, bench_row(state.schema, new_key, i)));
+			ok = record_id >= 0;
+			if (ok) {
+				state.record_ids.push_back(record_id);
+				state.key_count = state.record_ids.size();
+			}
+			break;
+		}
+		case Operation::Scan: {
+			// the storage layer has no key range scan, the records of consecutive keys are read instead;
+			// they were loaded in key order, so they sit on the same or neighbouring pages
+			size_t length = scan_length(random);
+			for (size_t k = key; k < key + length && k < state.key_count.load(); k++) {
+				ok = !state.storage.get(state.table, state.record_id(k)).empty() && ok;
+			}
+			break;
+		}
+		default:
+			break;
+		}
+
+		result.latencies_us[(int)operation].push_back(elapsed_us(start));
+		if (!ok) {
+			result.failed++;
+		}
+	}
+}
+
+static YcsbConfig parse_args(int argc, char** argv) {
+	YcsbConfig config;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			throw std::runtime_error("Missing value for " + arg);
+		}
+		std::string value = argv[++i];
+
+		if (arg == "--workload") {
+			config.workload = value;
+		}
+		else if (arg == "--records") {
+			config.records = std::stoull(value);
+		}
+		else if (arg == "--ops") {
+			config.ops = std::stoull(value);
+		}
+		else if (arg == "--threads") {
+			config.threads = std::stoull(value);
+		}
+		else if (arg == "--record-size") {
+			config.record_size = std::stoull(value);
+		}
+		else if (arg == "--distribution") {
+			config.distribution = value;
+		}
+		else if (arg == "--max-scan-length") {
+			config.max_scan_length = std::stoull(value);
+		}
+		else if (arg == "--durability") {
+			config.durability = value;
+		}
+		else if (arg == "--seed") {
+			config.seed = std::stoull(value);
+		}
+		else if (arg == "--dir") {
+			config.dir = value;
+		}
+		else if (arg == "--output") {
+			config.output = value;
+		}
+		else {
+			throw std::runtime_error("Unknown option " + arg);
+		}
+	}
+
+	if (config.records == 0 || config.threads == 0) {
+		throw std::runtime_error("--records and --threads have to be positive");
+	}
+	if (!config.distribution.empty() && config.distribution != "uniform" && config.distribution != "zipfian" && config.distribution != "latest") {
+		throw std::runtime_error("Unknown key distribution: " + config.distribution);
+	}
+	if (config.durability != "sync" && config.durability != "async") {
+		throw std::runtime_error("Unknown durability: " + config.durability);
+	}
+	return config;
+}
+
+static void write_json(std::ostream& out, const YcsbConfig& config, const Workload& workload, double load_ms, double run_ms, const ClientResult& total) {
+	size_t ops = 0;
+	for (auto& latencies : total.latencies_us) {
+		ops += latencies.size();
+	}
+
+	out << std::fixed << std::setprecision(3);
+	out << "{\n";
+	out << "  \"config\": {\"workload\": \"" << json_escape(config.workload) << "\", \"records\": " << config.records
+		<< ", \"ops\": " << config.ops << ", \"threads\": " << config.threads << ", \"record_size\": " << config.record_size
+		<< ", \"distribution\": \"" << json_escape(workload.distribution) << "\", \"durability\": \"" << config.durability
+		<< "\", \"seed\": " << config.seed << "},\n";
+	out << "  \"load_ms\": " << load_ms << ",\n";
+	out << "  \"run_ms\": " << run_ms << ",\n";
+	out << "  \"throughput_ops_per_sec\": " << (run_ms > 0 ? ops / (run_ms / 1000.0) : 0) << ",\n";
+	out << "  \"failed\": " << total.failed << ",\n";
+	out << "  \"operations\": [\n";
+
+	bool first = true;
+	for (int op = 0; op < (int)Operation::Count; op++) {
+		std::vector<double> sorted = total.latencies_us[op];
+		if (sorted.empty()) {
+			continue;
+		}
+		std::sort(sorted.begin(), sorted.end());
+
+		double mean = 0;
+		for (double latency : sorted) {
+			mean += latency;
+		}
+		mean /= sorted.size();
+
+		out << (first ? "" : ",\n");
+		out << "    {\"name\": \"" << operation_names[op] << "\", \"count\": " << sorted.size()
+			<< ", \"mean_us\": " << mean
+			<< ", \"p50_us\": " << percentile(sorted, 0.5)
+			<< ", \"p95_us\": " << percentile(sorted, 0.95)
+			<< ", \"p99_us\": " << percentile(sorted, 0.99)
+			<< ", \"p999_us\": " << percentile(sorted, 0.999)
+			<< ", \"max_us\": " << sorted.back() << "}";
+		first = false;
+	}
+
+	out << "\n  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+	YcsbConfig config;
+	Workload workload;
+	try {
+		config = parse_args(argc, argv);
+		workload = make_workload(config.workload);
+		if (!config.distribution.empty()) {
+			workload.distribution = config.distribution;
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 2;
+	}
+
+	std::filesystem::path dir = config.dir.empty()
+		? std::filesystem::temp_directory_path() / ("ycsb_bench_" + std::to_string(BenchClock::now().time_since_epoch().count()))
+		: std::filesystem::path(config.dir);
+	std::filesystem::remove_all(dir);
+
+	// the storage layer reports problems on std::cout, stdout is kept for the JSON results
+	std::streambuf* stdout_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+	double load_ms = 0;
+	double run_ms = 0;
+	ClientResult total;
+
+	try {
+		FileStorageLayer storage;
+		storage.open(dir.string());
+
+		WriteBackSettings write_back;
+		write_back.durability = config.durability == "async" ? Durability::Async : Durability::Sync;
+		storage.set_write_back_settings(write_back);
+
+		TableSchema schema = bench_schema(config.record_size);
+		storage.create_table("usertable", schema);
+		SharedState state(storage, schema, "usertable");
+
+		// load phase: records in key order, inserted in batches
+		auto load_start = BenchClock::now();
+		const size_t batch = 10000;
+		for (size_t first = 0; first < config.records; first += batch) {
+			std::vector<std::vector<uint8_t>> records;
+			for (size_t key = first; key < std::min(config.records, first + batch); key++) {
+				records.push_back(state.executor.packRecord(schema, bench_row(schema, key, 0)));
+			}
+			auto ids = storage.insert_many(state.table, records);
+			state.record_ids.insert(state.record_ids.end(), ids.begin(), ids.end());
+		}
+		state.key_count = state.record_ids.size();
+		load_ms = elapsed_us(load_start) / 1000.0;
+		std::cerr << "loaded " << state.record_ids.size() << " records into " << storage.page_count(state.table) << " pages" << std::endl;
+
+		// run phase: the operations are split evenly over the clients
+		std::vector<ClientResult> results(config.threads);
+		std::vector<std::thread> clients;
+
+		auto run_start = BenchClock::now();
+		for (size_t t = 0; t < config.threads; t++) {
+			size_t ops = config.ops / config.threads + (t < config.ops % config.threads ? 1 : 0);
+			clients.emplace_back(run_client, std::ref(state), std::cref(config), std::cref(workload), ops, config.seed + t + 1, std::ref(results[t]));
+		}
+		for (auto& client : clients) {
+			client.join();
+		}
+		run_ms = elapsed_us(run_start) / 1000.0;
+
+		for (auto& result : results) {
+			for (int op = 0; op < (int)Operation::Count; op++) {
+				total.latencies_us[op].insert(total.latencies_us[op].end(), result.latencies_us[op].begin(), result.latencies_us[op].end());
+			}
+			total.failed += result.failed;
+		}
+
+		storage.close();
+	}
+	catch (const std::exception& e) {
+		std::cout.rdbuf(stdout_buffer);
+		std::cerr << "benchmark failed: " << e.what() << std::endl;
+		std::filesystem::remove_all(dir);
+		return 1;
+	}
+
+	std::cout.rdbuf(stdout_buffer);
+	if (config.dir.empty()) {
+		std::filesystem::remove_all(dir);
+	}
+
+	if (config.output.empty()) {
+		write_json(std::cout, config, workload, load_ms, run_ms, total);
+	}
+	else {
+		std::ofstream out(config.output);
+		write_json(out, config, workload, load_ms, run_ms, total);
+	}
+
+	return 0;
+}
@@ -0,0 +1,83 @@
+#include "dirty_pages.h"
+#include <cstring>
+
+bool DirtyPages::read(size_t page_num, std::vector<uint8_t>& page) const {
+	if (staged.load() == 0) {
+		return false;
+	}
+
+	PageImage image;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = pages.find(page_num);
+		if (it == pages.end()) {
+			return false;
+		}
+		image = it->second;
+	}
+	// images are never changed once staged, the copy is made without the mutex
+	page.assign(image->begin(), image->end());
+	return true;
+}
+
+bool DirtyPages::read(size_t page_num, void* data, size_t size) const {
+	if (staged.load() == 0) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = pages.find(page_num);
+	if (it == pages.end()) {
+		return false;
+	}
+	std::memcpy(data, it->second->data(), size);
+	return true;
+}
+
+void DirtyPages::stage(size_t page_num, const std::vector<uint8_t>& page) {
+	auto image = std::make_shared<const std::vector<uint8_t>>(page);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	pages[page_num] = std::move(image);
+	staged.store(pages.size());
+}
+
+std::map<size_t, PageImage> DirtyPages::collect() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return pages;
+}
+
+void DirtyPages::written(const std::map<size_t, PageImage>& written_pages) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& [page_num, image] : written_pages) {
+		auto it = pages.find(page_num);
+		if (it != pages.end() && it->second == image) {
+			pages.erase(it);
+		}
+	}
+	staged.store(pages.size());
+}
+
+size_t DirtyPages::count() const {
+	return staged.load();
+}
+
+size_t DirtyPages::end_page() const {
+	if (staged.load() == 0) {
+		return 0;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	return pages.empty() ? 0 : pages.rbegin()->first + 1;
+}
+
+size_t DirtyPages::memory_bytes() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t bytes = 0;
+
+	for (auto& [page_num, image] : pages) {
+		// a map node and the shared image
+		bytes += sizeof(page_num) + sizeof(image) + 2 * sizeof(void*) + sizeof(std::vector<uint8_t>) + image->capacity();
+	}
+	return bytes;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Image of a page as it was staged, shared between the buffer and a running write-back
+using PageImage = std::shared_ptr<const std::vector<uint8_t>>;
+
+/**
+ * Pages of one table file that were changed in memory and not written to the file yet. Writers stage the whole
+ * page under its page latch and readers look here before they read the file, so a staged page is seen at once.
+ * A write-back takes the staged images in page order, writes them and then drops the pages that were not staged
+ * again meanwhile. Write-backs of one table have to be serialized by the caller.
+ */
+class DirtyPages {
+public:
+	// Copy the newest image of the page, false if the page is clean and has to be read from the file
+	bool read(size_t page_num, std::vector<uint8_t>& page) const;
+
+	// Copy the first size bytes of the newest image, false if the page is clean
+	bool read(size_t page_num, void* data, size_t size) const;
+
+	void stage(size_t page_num, const std::vector<uint8_t>& page);
+
+	// Images of every staged page, in page order
+	std::map<size_t, PageImage> collect() const;
+
+	// Drop the pages that still hold the written images
+	void written(const std::map<size_t, PageImage>& pages);
+
+	size_t count() const;
+
+	// One past the last staged page, 0 without staged pages
+	size_t end_page() const;
+
+	size_t memory_bytes() const;
+
+private:
+	mutable std::mutex mutex;
+	std::map<size_t, PageImage> pages;
+	std::atomic<size_t> staged{ 0 }; // pages.size(), read without the mutex
+};
@@ -0,0 +1,107 @@
+#include "epoch.h"
+#include <algorithm>
+
+namespace {
+
+// Reader slot and guard nesting of the calling thread
+struct ThreadPin {
+	std::atomic<uint64_t>* epoch = nullptr;
+	std::atomic<bool>* in_use = nullptr;
+	size_t depth = 0;
+
+	~ThreadPin() {
+		if (in_use) {
+			in_use->store(false);
+		}
+	}
+};
+
+thread_local ThreadPin thread_pin;
+
+}
+
+EpochManager& EpochManager::instance() {
+	static EpochManager manager;
+	return manager;
+}
+
+EpochManager::~EpochManager() {
+	// no reader is left when the program ends
+	for (auto& object : retired) {
+		object.deleter(object.object);
+	}
+}
+
+void EpochManager::retire(const void* object, void (*deleter)(const void*)) {
+	// readers pinned from here on can not load the object anymore, it was unlinked before
+	uint64_t retired_at = epoch.fetch_add(1);
+
+	std::lock_guard<std::mutex> lock(retired_mutex);
+	retired.push_back({ object, deleter, retired_at });
+
+	if (retired.size() >= EPOCH_RECLAIM_BATCH) {
+		reclaim_locked();
+	}
+}
+
+size_t EpochManager::reclaim() {
+	std::lock_guard<std::mutex> lock(retired_mutex);
+	return reclaim_locked();
+}
+
+EpochManager::Reader& EpochManager::thread_reader() {
+	std::lock_guard<std::mutex> lock(readers_mutex);
+
+	for (auto& reader : readers) {
+		bool free = false;
+		if (reader->in_use.compare_exchange_strong(free, true)) {
+			return *reader;
+		}
+	}
+	readers.push_back(std::make_unique<Reader>());
+	readers.back()->in_use.store(true);
+	return *readers.back();
+}
+
+size_t EpochManager::reclaim_locked() {
+	uint64_t oldest = UINT64_MAX;
+	{
+		std::lock_guard<std::mutex> lock(readers_mutex);
+		for (auto& reader : readers) {
+			uint64_t pinned = reader->epoch.load();
+			if (pinned != 0) {
+				oldest = std::min(oldest, pinned);
+			}
+		}
+	}
+
+	// an object retired at epoch e may be held by readers pinned at e or earlier
+	auto waiting = std::partition(retired.begin(), retired.end(), [&](const Retired& object) {
+		return object.epoch >= oldest;
+	});
+	for (auto it = waiting; it != retired.end(); ++it) {
+		it->deleter(it->object);
+	}
+	retired.erase(waiting, retired.end());
+	return retired.size();
+}
+
+EpochGuard::EpochGuard() {
+	if (thread_pin.depth++ > 0) {
+		return;
+	}
+
+	if (!thread_pin.epoch) {
+		auto& reader = EpochManager::instance().thread_reader();
+		thread_pin.epoch = &reader.epoch;
+		thread_pin.in_use = &reader.in_use;
+	}
+	// sequentially consistent: the pin is visible to reclaim before the guarded pointers are loaded
+	thread_pin.epoch->store(EpochManager::instance().epoch.load());
+}
+
+EpochGuard::~EpochGuard() {
+	if (--thread_pin.depth == 0) {
+		thread_pin.epoch->store(0, std::memory_order_release);
+	}
+}
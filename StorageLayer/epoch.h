@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+static const size_t EPOCH_RECLAIM_BATCH = 64; // retired objects collected before a reclaim pass
+
+/**
+ * Epoch-based reclamation for structures that are read without locks. A reader pins the current epoch with an
+ * EpochGuard while it uses pointers loaded from the structure. A writer unlinks an object first and then retires
+ * it; the object is freed once every reader that was pinned when it was retired has unpinned.
+ */
+class EpochManager {
+public:
+	static EpochManager& instance();
+	~EpochManager();
+
+	EpochManager(const EpochManager&) = delete;
+	EpochManager& operator=(const EpochManager&) = delete;
+
+	template<class T>
+	void retire(const T* object) {
+		retire(object, [](const void* retired) { delete static_cast<const T*>(retired); });
+	}
+
+	void retire(const void* object, void (*deleter)(const void*));
+
+	// Free the retired objects no reader can hold anymore, returns the number still waiting
+	size_t reclaim();
+
+private:
+	friend class EpochGuard;
+
+	// Pinned epoch of one thread, 0 while it is not pinned. A cache line each, pinning threads do not share lines.
+	struct alignas(64) Reader {
+		std::atomic<uint64_t> epoch{ 0 };
+		std::atomic<bool> in_use{ false };
+	};
+
+	struct Retired {
+		const void* object;
+		void (*deleter)(const void*);
+		uint64_t epoch; // epoch before the retire
+	};
+
+	EpochManager() = default;
+
+	// Slot of the calling thread, taken on its first pin and given back when the thread exits
+	Reader& thread_reader();
+	size_t reclaim_locked();
+
+	std::atomic<uint64_t> epoch{ 1 };
+
+	std::mutex readers_mutex;
+	std::vector<std::unique_ptr<Reader>> readers; // never shrinks, slots of exited threads are reused
+
+	std::mutex retired_mutex;
+	std::vector<Retired> retired;
+};
+
+// Pins the current epoch for the calling thread while in scope, guards of one thread may nest
+class EpochGuard {
+public:
+	EpochGuard();
+	~EpochGuard();
+
+	EpochGuard(const EpochGuard&) = delete;
+	EpochGuard& operator=(const EpochGuard&) = delete;
+};
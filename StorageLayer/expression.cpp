@@ -0,0 +1,425 @@
+#include "expression.h"
+#include <algorithm>
+#include <stdexcept>
+
+std::vector<Expr> split_conjuncts(const Expr& expr) {
+	std::vector<Expr> terms;
+
+	if (expr.type != "and") {
+		terms.push_back(expr);
+		return terms;
+	}
+
+	for (auto& child : expr.children) {
+		auto child_terms = split_conjuncts(child);
+		terms.insert(terms.end(), child_terms.begin(), child_terms.end());
+	}
+	return terms;
+}
+
+Expr make_conjunction(std::vector<Expr> terms) {
+	if (terms.size() == 1) {
+		return std::move(terms[0]);
+	}
+
+	Expr expr;
+	expr.type = "and";
+	expr.children = std::move(terms);
+	return expr;
+}
+
+void collect_columns(const Expr& expr, std::vector<std::string>& columns) {
+	if (!expr.column.empty()) {
+		columns.push_back(expr.column);
+	}
+
+	for (auto& child : expr.children) {
+		collect_columns(child, columns);
+	}
+}
+
+// Literal as a value of the column type, nullopt if it does not convert
+static std::optional<Value> stats_value(const ColumnStats& stats, const std::string& literal) {
+	try {
+		return stats.type == DataType::INT ? Value(std::stoi(literal)) : Value(literal);
+	}
+	catch (const std::exception&) {
+		return std::nullopt;
+	}
+}
+
+// Fraction of rows equal to the value
+static double equal_fraction(const ColumnStats& stats, const Value& value) {
+	if (stats.min && stats.max && (value < *stats.min || *stats.max < value)) {
+		return 0.0;
+	}
+	return 1.0 / stats.distinct_values();
+}
+
+static double predicate_selectivity(const ColumnStats& stats, const Expr& expr) {
+	std::vector<Value> values;
+	for (auto& literal : expr.values) {
+		auto value = stats_value(stats, literal);
+		if (!value) {
+			return 0.33;
+		}
+		values.push_back(*value);
+	}
+
+	double selectivity = 1.0;
+
+	if (expr.type == "compare") {
+		double equal = equal_fraction(stats, values[0]);
+		double below = fraction_below(stats, values[0]);
+
+		if (expr.op == "=") {
+			selectivity = equal;
+		}
+		else if (expr.op == "!=") {
+			selectivity = 1.0 - equal;
+		}
+		else if (expr.op == "<") {
+			selectivity = below;
+		}
+		else if (expr.op == "<=") {
+			selectivity = below + equal;
+		}
+		else if (expr.op == ">") {
+			selectivity = 1.0 - below - equal;
+		}
+		else {
+			selectivity = 1.0 - below;
+		}
+	}
+	else if (expr.type == "in") {
+		std::sort(values.begin(), values.end());
+		values.erase(std::unique(values.begin(), values.end()), values.end());
+
+		selectivity = 0.0;
+		for (auto& value : values) {
+			selectivity += equal_fraction(stats, value);
+		}
+	}
+	else if (expr.type == "between") {
+		selectivity = fraction_below(stats, values[1]) - fraction_below(stats, values[0]) + equal_fraction(stats, values[1]);
+	}
+	else if (expr.type == "is_null") {
+		selectivity = 0.0; // stored columns are never NULL
+	}
+
+	selectivity = std::clamp(selectivity, 0.0, 1.0);
+	return expr.negated ? 1.0 - selectivity : selectivity;
+}
+
+double estimate_selectivity(const Expr& expr, const StatsLookup& stats) {
+	double selectivity = 1.0;
+
+	if (expr.type == "and") {
+		for (auto& child : expr.children) {
+			selectivity *= estimate_selectivity(child, stats);
+		}
+		return selectivity;
+	}
+
+	if (expr.type == "or") {
+		double miss = 1.0;
+		for (auto& child : expr.children) {
+			miss *= 1.0 - estimate_selectivity(child, stats);
+		}
+		return 1.0 - miss;
+	}
+
+	if (expr.type == "not") {
+		return 1.0 - estimate_selectivity(expr.children[0], stats);
+	}
+
+	const ColumnStats* column_stats = stats ? stats(expr.column) : nullptr;
+	if (column_stats != nullptr && (expr.type == "is_null" || !expr.values.empty())) {
+		return predicate_selectivity(*column_stats, expr);
+	}
+
+	// rough defaults for tables without statistics
+	if (expr.type == "compare") {
+		if (expr.op == "=") {
+			selectivity = 0.1;
+		}
+		else if (expr.op == "!=") {
+			selectivity = 0.9;
+		}
+		else {
+			selectivity = 0.33;
+		}
+	}
+	else if (expr.type == "in") {
+		selectivity = std::min(1.0, 0.1 * expr.values.size());
+	}
+	else if (expr.type == "between") {
+		selectivity = 0.25;
+	}
+	else if (expr.type == "is_null") {
+		selectivity = 0.0; // stored columns are never NULL
+	}
+
+	return expr.negated ? 1.0 - selectivity : selectivity;
+}
+
+// Literals that are not integers are quoted
+static std::string literal_to_string(const std::string& literal) {
+	bool number = !literal.empty() && literal.find_first_not_of("-0123456789") == std::string::npos;
+	return number ? literal : "'" + literal + "'";
+}
+
+std::string expr_to_string(const Expr& expr) {
+	if (expr.type == "and" || expr.type == "or") {
+		std::string text = "(";
+		for (size_t i = 0; i < expr.children.size(); i++) {
+			if (i > 0) {
+				text += expr.type == "and" ? " AND " : " OR ";
+			}
+			text += expr_to_string(expr.children[i]);
+		}
+		return text + ")";
+	}
+
+	if (expr.type == "not") {
+		return "NOT " + expr_to_string(expr.children.at(0));
+	}
+
+	std::string negation = expr.negated ? "NOT " : "";
+
+	if (expr.type == "in") {
+		std::string text = expr.column + " " + negation + "IN (";
+		for (size_t i = 0; i < expr.values.size(); i++) {
+			text += (i > 0 ? ", " : "") + literal_to_string(expr.values[i]);
+		}
+		return text + ")";
+	}
+
+	if (expr.type == "between" && expr.values.size() == 2) {
+		return expr.column + " " + negation + "BETWEEN " + literal_to_string(expr.values[0]) + " AND " + literal_to_string(expr.values[1]);
+	}
+
+	if (expr.type == "is_null") {
+		return expr.column + " IS " + negation + "NULL";
+	}
+
+	return expr.column + " " + expr.op + " " + (expr.values.empty() ? "?" : literal_to_string(expr.values[0]));
+}
+
+// Terms of nested ANDs (or ORs) as one list
+static void flatten_terms(const Expr& expr, const std::string& type, std::vector<const Expr*>& terms) {
+	for (auto& child : expr.children) {
+		if (child.type == type) {
+			flatten_terms(child, type, terms);
+		}
+		else {
+			terms.push_back(&child);
+		}
+	}
+}
+
+CompiledFilter::CompiledFilter(const Expr& expr, const TableSchema& schema, const StatsLookup& stats) {
+	schemas.push_back(schema);
+
+	compile(expr, [&schema](const std::string& name) {
+		int index = find_column(schema, name);
+		if (index < 0) {
+			throw std::runtime_error("Unknown WHERE column: " + name);
+		}
+		return std::make_pair(0, index);
+	}, stats);
+}
+
+CompiledFilter::CompiledFilter(const Expr& expr, const std::vector<const TableSchema*>& inputs, const ColumnResolver& resolve, const StatsLookup& stats) {
+	for (auto* schema : inputs) {
+		schemas.push_back(*schema);
+	}
+
+	compile(expr, resolve, stats);
+}
+
+void CompiledFilter::compile(const Expr& expr, const ColumnResolver& resolve, const StatsLookup& stats) {
+	if (expr.type == "and" || expr.type == "or") {
+		bool conjunction = expr.type == "and";
+
+		std::vector<const Expr*> terms;
+		flatten_terms(expr, expr.type, terms);
+
+		// AND tests the term most likely to fail first, OR the term most likely to match
+		std::vector<std::pair<double, const Expr*>> ordered;
+		for (auto* term : terms) {
+			ordered.emplace_back(estimate_selectivity(*term, stats), term);
+		}
+		std::stable_sort(ordered.begin(), ordered.end(), [&](auto& a, auto& b) {
+			return conjunction ? a.first < b.first : a.first > b.first;
+		});
+
+		std::vector<size_t> jumps;
+		for (size_t i = 0; i < ordered.size(); i++) {
+			compile(*ordered[i].second, resolve, stats);
+
+			if (i + 1 < ordered.size()) {
+				jumps.push_back(program.size());
+				program.push_back({ conjunction ? OpCode::JumpIfFalse : OpCode::JumpIfTrue, 0 });
+			}
+		}
+
+		for (size_t jump : jumps) {
+			program[jump].operand = (int)program.size();
+		}
+	}
+	else if (expr.type == "not") {
+		compile(expr.children.at(0), resolve, stats);
+		program.push_back({ OpCode::Not, 0 });
+	}
+	else {
+		program.push_back({ OpCode::Test, addPredicate(expr, resolve) });
+	}
+}
+
+int CompiledFilter::addPredicate(const Expr& expr, const ColumnResolver& resolve) {
+	Predicate predicate;
+	auto [side, index] = resolve(expr.column);
+	predicate.side = side;
+	predicate.index = index;
+	predicate.negated = expr.negated;
+
+	const TableSchema& schema = schemas[side];
+	const Column& column = schema.columns[index];
+
+	// columns behind fixed size columns are read without walking the record
+	int offset = 0;
+	for (int i = 0; i < index && offset >= 0; i++) {
+		offset = schema.columns[i].type == DataType::INT ? offset + (int)sizeof(int) : -1;
+	}
+	predicate.fixed_offset = offset;
+
+	for (auto& literal : expr.values) {
+		try {
+			predicate.values.push_back(parse_value(column, literal));
+		}
+		catch (const std::exception&) {
+			throw std::runtime_error("Invalid value for column " + column.name + ": " + literal);
+		}
+	}
+
+	size_t expected = expr.type == "compare" ? 1 : expr.type == "between" ? 2 : 0;
+	if ((expected != 0 && expr.values.size() != expected) || (expr.type == "in" && expr.values.empty())) {
+		throw std::runtime_error("Invalid number of values for " + expr.type);
+	}
+
+	if (expr.type == "compare") {
+		predicate.kind = PredicateKind::Compare;
+
+		if (expr.op == "=") {
+			predicate.op = CompareOp::Eq;
+		}
+		else if (expr.op == "!=") {
+			predicate.op = CompareOp::Ne;
+		}
+		else if (expr.op == "<") {
+			predicate.op = CompareOp::Lt;
+		}
+		else if (expr.op == "<=") {
+			predicate.op = CompareOp::Le;
+		}
+		else if (expr.op == ">") {
+			predicate.op = CompareOp::Gt;
+		}
+		else if (expr.op == ">=") {
+			predicate.op = CompareOp::Ge;
+		}
+		else {
+			throw std::runtime_error("Unsupported operator: " + expr.op);
+		}
+	}
+	else if (expr.type == "in") {
+		predicate.kind = PredicateKind::In;
+		std::sort(predicate.values.begin(), predicate.values.end());
+		predicate.values.erase(std::unique(predicate.values.begin(), predicate.values.end()), predicate.values.end());
+	}
+	else if (expr.type == "between") {
+		predicate.kind = PredicateKind::Between;
+	}
+	else if (expr.type == "is_null") {
+		predicate.kind = PredicateKind::IsNull;
+	}
+	else {
+		throw std::runtime_error("Unsupported expression: " + expr.type);
+	}
+
+	predicates.push_back(std::move(predicate));
+	return (int)predicates.size() - 1;
+}
+
+bool CompiledFilter::test(const Predicate& predicate, const std::vector<uint8_t>* const* records) const {
+	const std::vector<uint8_t>* record = records[predicate.side];
+
+	// a missing input only matches IS NULL, stored columns are never NULL
+	if (predicate.kind == PredicateKind::IsNull) {
+		return (record == nullptr) != predicate.negated;
+	}
+	if (record == nullptr) {
+		return false;
+	}
+
+	const TableSchema& schema = schemas[predicate.side];
+	Value value = predicate.fixed_offset >= 0
+		? read_value(schema.columns[predicate.index], *record, predicate.fixed_offset)
+		: read_column(schema, *record, predicate.index);
+
+	switch (predicate.kind) {
+	case PredicateKind::Compare: {
+		const Value& operand = predicate.values[0];
+
+		switch (predicate.op) {
+		case CompareOp::Eq: return value == operand;
+		case CompareOp::Ne: return value != operand;
+		case CompareOp::Lt: return value < operand;
+		case CompareOp::Le: return value <= operand;
+		case CompareOp::Gt: return value > operand;
+		case CompareOp::Ge: return value >= operand;
+		}
+		return false;
+	}
+	case PredicateKind::In:
+		return std::binary_search(predicate.values.begin(), predicate.values.end(), value) != predicate.negated;
+	case PredicateKind::Between:
+		return (!(value < predicate.values[0]) && !(predicate.values[1] < value)) != predicate.negated;
+	default:
+		return false;
+	}
+}
+
+bool CompiledFilter::operator()(const std::vector<uint8_t>& record) const {
+	const std::vector<uint8_t>* records[1] = { &record };
+	return evaluate(records);
+}
+
+bool CompiledFilter::evaluate(const std::vector<uint8_t>* const* records) const {
+	bool result = true;
+	size_t pc = 0;
+
+	while (pc < program.size()) {
+		const Instruction& instruction = program[pc];
+
+		switch (instruction.code) {
+		case OpCode::Test:
+			result = test(predicates[instruction.operand], records);
+			pc++;
+			break;
+		case OpCode::JumpIfFalse:
+			pc = result ? pc + 1 : instruction.operand;
+			break;
+		case OpCode::JumpIfTrue:
+			pc = result ? instruction.operand : pc + 1;
+			break;
+		case OpCode::Not:
+			result = !result;
+			pc++;
+			break;
+		}
+	}
+
+	return result;
+}
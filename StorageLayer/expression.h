@@ -0,0 +1,79 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <utility>
+#include <cstdint>
+#include "ast.h"
+#include "table_schema.h"
+#include "record_codec.h"
+#include "table_stats.h"
+
+// Column of one input of a filter: side (0 for single table filters) and column index
+using ColumnResolver = std::function<std::pair<int, int>(const std::string& name)>;
+
+// Statistics of a referenced column, nullptr when the table was not analyzed
+using StatsLookup = std::function<const ColumnStats*(const std::string& name)>;
+
+// Top level AND terms of an expression
+std::vector<Expr> split_conjuncts(const Expr& expr);
+
+// AND of the given terms, the term itself if there is only one
+Expr make_conjunction(std::vector<Expr> terms);
+
+// Names of all columns referenced by the expression
+void collect_columns(const Expr& expr, std::vector<std::string>& columns);
+
+// Estimated fraction of rows matching the expression, from column statistics when available
+double estimate_selectivity(const Expr& expr, const StatsLookup& stats = nullptr);
+
+// SQL text of the expression, as shown by EXPLAIN
+std::string expr_to_string(const Expr& expr);
+
+/**
+ * WHERE expression compiled once into a flat program. Literals are converted to typed values
+ * of their column, column positions are resolved up front and the terms of AND/OR are ordered
+ * by estimated selectivity, so evaluation short-circuits as early as possible.
+ */
+class CompiledFilter {
+public:
+	// Filter over the records of a single table
+	CompiledFilter(const Expr& expr, const TableSchema& schema, const StatsLookup& stats = nullptr);
+
+	// Filter over several inputs (e.g. both sides of a join), columns are mapped to inputs by the resolver
+	CompiledFilter(const Expr& expr, const std::vector<const TableSchema*>& schemas, const ColumnResolver& resolve, const StatsLookup& stats = nullptr);
+
+	bool operator()(const std::vector<uint8_t>& record) const;
+
+	// Records of every input, nullptr for a missing input (its columns are NULL)
+	bool evaluate(const std::vector<uint8_t>* const* records) const;
+
+private:
+	enum class PredicateKind { Compare, In, Between, IsNull };
+	enum class CompareOp { Eq, Ne, Lt, Le, Gt, Ge };
+
+	struct Predicate {
+		PredicateKind kind;
+		CompareOp op = CompareOp::Eq;
+		bool negated = false; // NOT IN, NOT BETWEEN, IS NOT NULL
+		int side = 0;
+		int index = 0;
+		int fixed_offset = -1; // byte offset when all preceding columns are INT, -1 otherwise
+		std::vector<Value> values; // sorted for IN
+	};
+
+	enum class OpCode { Test, JumpIfFalse, JumpIfTrue, Not };
+
+	struct Instruction {
+		OpCode code;
+		int operand; // predicate for Test, target instruction for jumps
+	};
+
+	std::vector<TableSchema> schemas; // copies, the filter may outlive the caller's schemas
+	std::vector<Predicate> predicates;
+	std::vector<Instruction> program;
+
+	void compile(const Expr& expr, const ColumnResolver& resolve, const StatsLookup& stats);
+	int addPredicate(const Expr& expr, const ColumnResolver& resolve);
+	bool test(const Predicate& predicate, const std::vector<uint8_t>* const* records) const;
+};
@@ -1,176 +1,413 @@
 #include "file_storage_layer.h"
+#include <cstdio>
+#include <cstring>
+#include "trace.h"
+#include "epoch.h"
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Records the latency of one storage call and logs it when it is slower than the slow log threshold
+class StorageOperation {
+public:
+    StorageOperation(FileStorageLayer& storage, LatencyOp op, const std::string& table)
+        : storage(storage), op(op), table(table), start(std::chrono::steady_clock::now()) {
+        if (storage.slow_log().enabled()) {
+            io_before = storage.counters_snapshot();
+        }
+    }
+
+    ~StorageOperation() {
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        storage.latencies().record(op, elapsed);
+
+        double duration_ms = elapsed / 1e6;
+        if (io_before && storage.slow_log().is_slow(duration_ms)) {
+            SlowQueryEntry entry;
+            entry.kind = latency_op_name(op);
+            entry.table = table;
+            entry.duration_ms = duration_ms;
+            entry.io = storage.counters_snapshot().since(*io_before);
+            storage.slow_log().write(entry);
+        }
+    }
+
+    StorageOperation(const StorageOperation&) = delete;
+    StorageOperation& operator=(const StorageOperation&) = delete;
+
+private:
+    FileStorageLayer& storage;
+    LatencyOp op;
+    const std::string& table;
+    std::chrono::steady_clock::time_point start;
+    std::optional<StorageStats> io_before;
+};
 
 // MAIN CLASS IMPLEMENTATION
 
 FileStorageLayer::FileStorageLayer()
-    : is_open(false), is_vacuum(false), storage_path("") {
+    : is_open(false), storage_path(""),
+      scan_pool(std::make_unique<ThreadPool>(std::thread::hardware_concurrency())) {
 }
 
 FileStorageLayer::~FileStorageLayer() {
     if (is_open) {
         close();
     }
+    delete published_latches.load(); // no lookup is left
 }
 
 void FileStorageLayer::open(const std::string& path) {
+    if (is_open) {
+        close(); // stops the background workers before new ones are started
+    }
+
     storage_path = path;
 	ensure_directory_exists(path);
-	load_table_schemas(); // Load existing table schemas if any
 
-    for (auto& index : table_schemas) {
-		auto& buckets = index_buckets[index.first];
-		buckets.assign(INDEX_BUCKET_SIZE, std::vector<int>()); // Initialize index buckets for each table
-		load_index_buckets(index.first); // Load index buckets from file
-	}
+    std::vector<std::string> tables;
+    {
+        std::unique_lock<std::shared_mutex> catalog(catalog_latch);
+        table_schemas.clear(); // tables of a path opened before
+        table_latches.clear();
+        load_table_schemas(); // Load existing table schemas if any
+
+        for (auto& index : table_schemas) {
+            table_latches[index.first] = std::make_shared<TableLatches>(); // with empty index buckets
+
+            auto stats = load_table_stats(storage_path + "/" + index.first + ".stats");
+            if (stats) {
+                table_stats[index.first] = *stats;
+            }
+            tables.push_back(index.first);
+        }
+        publish_table_latches();
+    }
+
+    for (auto& table : tables) {
+        load_index_buckets(table); // Load index buckets from file
+    }
 
     is_open = true;
+
+    vacuum_stop = false;
+    vacuum_thread = std::thread(&FileStorageLayer::vacuum_loop, this);
+
+    page_writer_stop = false;
+    page_writer_thread = std::thread(&FileStorageLayer::page_writer_loop, this);
 }
 
 void FileStorageLayer::close() {
+    {
+        std::lock_guard<std::mutex> lock(vacuum_mutex);
+        vacuum_stop = true;
+    }
+    vacuum_wake.notify_all();
+    if (vacuum_thread.joinable()) {
+        vacuum_thread.join(); // a page being compacted is finished first
+    }
 
-    for (auto& index : table_schemas) {
-        save_index_buckets(index.first); // Save index buckets before closing
-	}
+    {
+        std::lock_guard<std::mutex> lock(page_writer_mutex);
+        page_writer_stop = true;
+    }
+    page_writer_wake.notify_all();
+    if (page_writer_thread.joinable()) {
+        page_writer_thread.join();
+    }
+
+    std::vector<std::string> tables;
+    {
+        std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+        for (auto& index : table_schemas) {
+            tables.push_back(index.first);
+        }
+    }
+
+    for (auto& table : tables) {
+        auto latch = latch_table<ExclusiveLatch>(table);
+        if (!latch) {
+            continue;
+        }
+
+        write_back(table, *latch.latches); // pages the page writer has not written yet
+        save_index_buckets(table); // Save index buckets before closing
+
+        std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+        auto stats = table_stats.find(table);
+        if (stats != table_stats.end()) {
+            save_table_stats(storage_path + "/" + table + ".stats", stats->second); // Keep the row counts of later writes
+        }
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> catalog(catalog_latch);
+        table_stats.clear();
+    }
+
+    std::ofstream latency_file(std::filesystem::path(storage_path) / "latency.json", std::ios::trunc);
+    latency.write_json(latency_file);
 
     is_open = false;
 }
 
 int FileStorageLayer::insert(const std::string& table, const std::vector<uint8_t>& record) {
+    counters.add(StorageCounter::InsertCalls);
+    StorageOperation operation(*this, LatencyOp::Insert, table);
+
     if (!is_open) {
         std::cout << "Storage is not open. Cannot insert record." << std::endl;
         return -1;
 	}
 
-    if (!is_table_exists(table)) {
+    auto latch = latch_table<SharedLatch>(table);
+
+    if (!latch) {
         std::cout << "Table does not exist." << std::endl;
         return -1;
 	}
 
 	auto tableFile = std::filesystem::path(storage_path) / (table + ".db");
+	TableLatches& latches = *latch.latches;
 
     int recordId;
 
     {
-        std::fstream page(tableFile, std::ios::binary | std::ios::in | std::ios::out);
+        std::ifstream file;
 
-        if (!page.is_open()) {
-            std::cout << "Failed to open table file." << std::endl;
+        if (sizeof(PageHeader) + sizeof(uint16_t) + sizeof(uint32_t) + record.size() > PAGE_SIZE) {
+            std::cout << "Record does not fit into a page." << std::endl;
             return -1;
         }
 
-        // Prepare a buffer for the record
-        uint32_t record_size = record.size();
-        std::vector<uint8_t> buffer(sizeof(record_size) + record_size); // Buffer to hold record size and data
-        std::memcpy(buffer.data(), &record_size, sizeof(record_size)); // Copy record size
-        std::memcpy(buffer.data() + sizeof(record_size), record.data(), record_size); // Copy record data
-
-        // Count the number of pages in the file
-        auto file_size = std::filesystem::file_size(tableFile);
-        size_t num_pages = file_size / PAGE_SIZE;
-
         uint16_t page_num = 0;
-        PageHeader header;
+        int slot;
+        std::vector<uint8_t> buffer(PAGE_SIZE);
+        std::unique_lock<std::shared_mutex> page_latch;
+        size_t num_pages = table_pages(table); // pages are never removed, counted again only at the end
 
         while (true) {
             if (page_num >= num_pages) {
-                // If we reach the end of the file, we need to create a new page
-                header = { 0, (uint16_t)PAGE_SIZE };
-                page.seekp(page_num * PAGE_SIZE);
-                page.write(reinterpret_cast<const char*>(&header), sizeof(header));
-                break;
+                // Append an empty page, unless another insert has appended one meanwhile
+                std::lock_guard<std::mutex> append(latches.append);
+                num_pages = table_pages(table);
+
+                if (page_num >= num_pages) {
+                    std::vector<uint8_t> empty(PAGE_SIZE);
+                    init_page(empty);
+                    latches.dirty.stage(page_num, empty); // counted by table_pages from here on
+                    num_pages = page_num + 1;
+                }
             }
 
-            // Read the page header
-            page.seekg(page_num * PAGE_SIZE);
-            page.read(reinterpret_cast<char*>(&header), sizeof(header));
+            // A page latched by another writer is skipped, concurrent inserts spread over the pages with free space
+            page_latch = std::unique_lock<std::shared_mutex>(latches.page(page_num), std::try_to_lock);
 
-            // Calculate free space in the page
-            size_t used_space = header.slot_count * sizeof(uint16_t);
-            size_t free_space = header.free_space_offset - used_space - sizeof(header); // Subtract header size and used space
+            if (page_latch.owns_lock()) {
+                // the header tells whether the record fits, only that page is read whole
+                PageHeader header;
+                if (!load_page_header(file, tableFile, latches, page_num, header)) {
+                    std::cout << "Failed to read table file." << std::endl;
+                    return -1;
+                }
 
-            if (free_space >= record_size + sizeof(uint16_t)) {
-                break;
+                if (record_fits(header, record.size())) {
+                    if (!load_page(file, tableFile, latches, page_num, buffer)) {
+                        std::cout << "Failed to read table file." << std::endl;
+                        return -1;
+                    }
+                    slot = place_record(buffer, record);
+                    break;
+                }
+                page_latch.unlock();
             }
 
             page_num++;
         }
 
-        // Write the record to the page
-        uint16_t new_data = header.free_space_offset - buffer.size();
-        page.seekp(page_num * PAGE_SIZE + new_data);
-        page.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        latches.undo.record(page_num, slot, std::nullopt); // scans that started before do not see the record
 
-        uint16_t slot = header.slot_count;
-        page.seekp(page_num * PAGE_SIZE + sizeof(PageHeader) + slot * sizeof(uint16_t));
-        page.write(reinterpret_cast<const char*>(&new_data), sizeof(new_data));
-
-        // Update the page header
-        header.slot_count++;
-        header.free_space_offset = new_data;
-        page.seekp(page_num * PAGE_SIZE);
-        page.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        // other calls read the staged page once the latch is released
+        latches.dirty.stage(page_num, buffer);
 
 		recordId = make_record_id(page_num, slot); // Create record ID
     }
 
-    if (!is_vacuum) {
-        vacuum(table);
-    }
+    commit_pages(table, latches);
 
-	auto& buckets = index_buckets[table];
+    track_changes(table, &record, 1);
 
-    if (buckets.empty()) {
-		buckets.assign(INDEX_BUCKET_SIZE, std::vector<int>()); // Initialize index buckets if empty
-    }
+	std::string key = get_key(table, record); // Get the key for indexing
 
-	TableSchema schema = get_table_schema(table);
-	Column column = schema.columns[0]; // Assuming the first column is indexed for simplicity
+    latches.index.add(latches.index.bucket_of(key), recordId); // Add record ID to the index bucket
+    uint64_t version = ++latches.index_version;
+	persist_index(table, version); // Save the index buckets to file
 
-	size_t offset = 0;
-	std::string key = get_key(table, record); // Get the key for indexing
+	return recordId; // Return the record ID
+}
+
+std::vector<int> FileStorageLayer::insert_many(const std::string& table, const std::vector<std::vector<uint8_t>>& records) {
+    counters.add(StorageCounter::InsertManyCalls);
+    StorageOperation operation(*this, LatencyOp::InsertMany, table);
+    std::vector<int> record_ids;
 
-    size_t hash_value = std::hash<std::string>{}(key);
-    size_t bucket = hash_value % INDEX_BUCKET_SIZE;
+    if (!is_open) {
+        std::cout << "Storage is not open. Cannot insert records." << std::endl;
+        return record_ids;
+	}
+
+    auto latch = latch_table<SharedLatch>(table);
+
+    if (!latch) {
+        std::cout << "Table does not exist." << std::endl;
+        return record_ids;
+	}
+
+    UndoLog& undo = latch.latches->undo;
+    uint64_t batch = undo.begin_batch();
+    record_ids = insert_records(table, records, batch);
+    commit_pages(table, *latch.latches);
+    undo.commit(batch);
+
+    return record_ids;
+}
+
+std::vector<int> FileStorageLayer::insert_records(const std::string& table, const std::vector<std::vector<uint8_t>>& records, uint64_t batch) {
+    std::vector<int> record_ids;
+	auto tableFile = std::filesystem::path(storage_path) / (table + ".db");
+	TableLatches& latches = latches_of(table);
+	std::vector<std::pair<size_t, int>> index_entries; // bucket and record ID
+
+    {
+        std::ifstream file;
+        std::vector<uint8_t> buffer(PAGE_SIZE);
+        size_t next = 0;
+        size_t page_num = 0;
+        size_t num_pages = table_pages(table); // pages are never removed, counted again only at the end
+
+        // Fill the free space of the existing pages first, then append new pages
+        while (next < records.size()) {
+            if (sizeof(PageHeader) + sizeof(uint16_t) + sizeof(uint32_t) + records[next].size() > PAGE_SIZE) {
+                std::cout << "Record does not fit into a page." << std::endl;
+                record_ids.push_back(-1);
+                next++;
+                continue;
+            }
+
+            if (page_num >= num_pages) {
+                // Append an empty page, unless another insert has appended one meanwhile. The append latch is never
+                // held while waiting for a page latch, update_where appends while it holds one.
+                std::lock_guard<std::mutex> append(latches.append);
+                num_pages = table_pages(table);
+
+                if (page_num >= num_pages) {
+                    init_page(buffer);
+                    latches.dirty.stage(page_num, buffer);
+                    num_pages = page_num + 1;
+                }
+            }
+
+            std::unique_lock<std::shared_mutex> page_latch(latches.page(page_num));
+
+            PageHeader header;
+            if (!load_page_header(file, tableFile, latches, page_num, header)) {
+                std::cout << "Failed to read table file." << std::endl;
+                break;
+            }
+            if (!record_fits(header, records[next].size())) {
+                page_num++;
+                continue;
+            }
+
+            if (!load_page(file, tableFile, latches, page_num, buffer)) {
+                std::cout << "Failed to read table file." << std::endl;
+                break;
+            }
+
+            bool dirty = false;
+
+            while (next < records.size()) {
+                int slot = place_record(buffer, records[next]);
+
+                if (slot < 0) {
+                    break;
+                }
 
-    if (std::find(index_buckets[table][bucket].begin(), index_buckets[table][bucket].end(), recordId) == index_buckets[table][bucket].end()) {
-        index_buckets[table][bucket].push_back(recordId); // Add record ID to the index bucket
+                latches.undo.record_pending(batch, page_num, slot, std::nullopt);
+
+                int record_id = make_record_id(page_num, slot);
+                record_ids.push_back(record_id);
+
+                std::string key = get_key(table, records[next]);
+                index_entries.emplace_back(latches.index.bucket_of(key), record_id);
+                track_changes(table, &records[next], 1);
+
+                next++;
+                dirty = true;
+            }
+
+            if (dirty) {
+                latches.dirty.stage(page_num, buffer); // read by other calls once the latch is released
+            }
+
+            page_num++;
+        }
     }
-	save_index_buckets(table); // Save the index buckets to file
 
-	return recordId; // Return the record ID
+    if (index_entries.empty()) {
+        return record_ids;
+    }
+
+    latches.index.add_many(index_entries);
+    uint64_t version = ++latches.index_version;
+	persist_index(table, version); // Persist the index once for the whole batch
+
+    return record_ids;
 }
 
 std::vector<uint8_t> FileStorageLayer::get(const std::string& table, int record_id) {
+    counters.add(StorageCounter::GetCalls);
+    StorageOperation operation(*this, LatencyOp::Get, table);
+
     if (!is_open) {
         std::cout << "Storage is not open. Cannot retrieve record." << std::endl;
         return std::vector<uint8_t>();
 	}
 
-    if (!is_table_exists(table)) {
+    auto latch = latch_table<SharedLatch>(table);
+
+    if (!latch) {
         std::cout << "Table does not exist." << std::endl;
 		return std::vector<uint8_t>();
 	}
 
-	auto tableFile = std::filesystem::path(storage_path) / (table + ".db");
+	uint16_t page_num, slot_num;
+	split_record_id(record_id, page_num, slot_num);
 
-	std::ifstream page(tableFile, std::ios::binary);
+	std::shared_lock<std::shared_mutex> page_latch(latch.latches->page(page_num));
+    return read_record(table, record_id);
+}
 
-    if (!page.is_open()) {
-        std::cout << "Failed to open table file." << std::endl;
-		return std::vector<uint8_t>(); 
-	}
+std::vector<uint8_t> FileStorageLayer::read_record(const std::string& table, int record_id) {
+	auto tableFile = std::filesystem::path(storage_path) / (table + ".db");
+
+	std::ifstream file;
 
 	uint16_t page_num, slot_num;
 	split_record_id(record_id, page_num, slot_num);
 
-    if (page_num < 0 || slot_num < 0) {
+	// The whole page is read with one call, a staged page is not read from the file at all
+	std::vector<uint8_t> page(PAGE_SIZE);
+
+    if (record_id < 0 || !load_page(file, tableFile, latches_of(table), page_num, page)) {
         std::cout << "Invalid record ID." << std::endl;
 		return std::vector<uint8_t>(); 
 	}
 
 	PageHeader header;
-	page.seekg(page_num * PAGE_SIZE);
-	page.read(reinterpret_cast<char*>(&header), sizeof(header));
+	std::memcpy(&header, page.data(), sizeof(header));
 
     if (slot_num >= header.slot_count) {
 		std::cout << "Slot number out of bounds." << std::endl;
@@ -179,8 +416,7 @@ std::vector<uint8_t> FileStorageLayer::get(const std::string& table, int record_
 
 	// Read the slot offset
 	uint16_t slot_offset;
-	page.seekg(page_num * PAGE_SIZE + sizeof(PageHeader) + slot_num * sizeof(uint16_t));
-	page.read(reinterpret_cast<char*>(&slot_offset), sizeof(slot_offset));
+	std::memcpy(&slot_offset, page.data() + sizeof(PageHeader) + slot_num * sizeof(uint16_t), sizeof(slot_offset));
 	
     if (slot_offset == 0) {
 		std::cout << "Slot is empty." << std::endl;
@@ -193,64 +429,59 @@ std::vector<uint8_t> FileStorageLayer::get(const std::string& table, int record_
 	}
 
 	// Read the record size
-	uint32_t record_size;
-	page.seekg(page_num * PAGE_SIZE + slot_offset);
-	page.read(reinterpret_cast<char*>(&record_size), sizeof(record_size));
+	uint32_t record_size = 0;
+    if (slot_offset + sizeof(record_size) <= PAGE_SIZE) {
+        std::memcpy(&record_size, page.data() + slot_offset, sizeof(record_size));
+    }
 
-	// Read the record data
-	std::vector<uint8_t> record_data(record_size);
-	page.read(reinterpret_cast<char*>(record_data.data()), record_size);
-    if (!page) {
+    if (slot_offset + sizeof(record_size) + record_size > PAGE_SIZE) {
         std::cout << "Failed to read record data." << std::endl;
         return std::vector<uint8_t>();
 	}
 
-    return record_data;
+	// Read the record data
+	auto record_start = page.begin() + slot_offset + sizeof(record_size);
+    return std::vector<uint8_t>(record_start, record_start + record_size);
 }
 
 bool FileStorageLayer::update(const std::string& table, int record_id, const std::vector<uint8_t>& updated_record) {
+    counters.add(StorageCounter::UpdateCalls);
+    StorageOperation operation(*this, LatencyOp::Update, table);
+
     if (!is_open) {
         std::cout << "Storage is not open. Cannot update record." << std::endl;
 		return false;
     }
 
-    if (!is_table_exists(table)) {
+    auto latch = latch_table<SharedLatch>(table);
+
+    if (!latch) {
         std::cout << "Table does not exist." << std::endl;
         return false; 
     }
 
 	auto tableFile = std::filesystem::path(storage_path) / (table + ".db");
+	TableLatches& latches = *latch.latches;
 
-	// Get old record for comparison
-
-	std::vector<uint8_t> old_record = get(table, record_id);
-	std::string oldKey = get_key(table, old_record);
-
-    if (oldKey == std::string()) {
-        std::cout << "Error: Get Key function gave an error" << std::endl;
-        return false;
-    }
+	uint16_t page_num, slot_num;
+	split_record_id(record_id, page_num, slot_num);
 
+	// Held until the page is staged, the old record can not change in between
+	std::unique_lock<std::shared_mutex> page_latch(latches.page(page_num));
+	std::string oldKey;
 
     {
-        std::fstream page(tableFile, std::ios::binary | std::ios::in | std::ios::out);
-
-        if (!page.is_open()) {
-            std::cout << "Failed to open table file." << std::endl;
-            return false;
-        }
+        std::ifstream file;
 
-        uint16_t page_num, slot_num;
-        split_record_id(record_id, page_num, slot_num);
+        std::vector<uint8_t> buffer(PAGE_SIZE);
 
-        if (page_num < 0 || slot_num < 0) {
+        if (record_id < 0 || !load_page(file, tableFile, latches, page_num, buffer)) {
             std::cout << "Invalid record ID." << std::endl;
             return false;
         }
 
         PageHeader header;
-        page.seekg(page_num * PAGE_SIZE);
-        page.read(reinterpret_cast<char*>(&header), sizeof(header));
+        std::memcpy(&header, buffer.data(), sizeof(header));
 
         if (slot_num >= header.slot_count) {
             std::cout << "Slot number out of bounds." << std::endl;
@@ -258,371 +489,1347 @@ bool FileStorageLayer::update(const std::string& table, int record_id, const std
         }
 
         // Read the slot offset
+        uint8_t* slot = buffer.data() + sizeof(PageHeader) + slot_num * sizeof(uint16_t);
         uint16_t slot_offset;
-        page.seekg(page_num * PAGE_SIZE + sizeof(PageHeader) + slot_num * sizeof(uint16_t));
-        page.read(reinterpret_cast<char*>(&slot_offset), sizeof(slot_offset));
+        std::memcpy(&slot_offset, slot, sizeof(slot_offset));
 
-        if (slot_offset == 0 || slot_offset == DELETE_SLOT) {
+        if (slot_offset == 0 || slot_offset == DELETE_SLOT || slot_offset + sizeof(uint32_t) > PAGE_SIZE) {
             std::cout << "Slot is empty or marked as deleted." << std::endl;
             return false;
         }
 
-        // Read the record size
+        // Get old record for comparison
         uint32_t record_size;
-        page.seekg(page_num * PAGE_SIZE + slot_offset);
-        page.read(reinterpret_cast<char*>(&record_size), sizeof(record_size));
+        std::memcpy(&record_size, buffer.data() + slot_offset, sizeof(record_size));
 
+        if (slot_offset + sizeof(record_size) + record_size > PAGE_SIZE) {
+            std::cout << "Failed to read record data." << std::endl;
+            return false;
+        }
 
-        uint32_t updated_record_size = static_cast<uint32_t>(updated_record.size());
+        auto record_start = buffer.begin() + slot_offset + sizeof(record_size);
+        std::vector<uint8_t> old_record(record_start, record_start + record_size);
+        oldKey = get_key(table, old_record);
 
-        std::vector<uint8_t> buffer(sizeof(updated_record_size) + updated_record_size);
-        std::memcpy(buffer.data(), &updated_record_size, sizeof(updated_record_size)); // Copy updated record size
-        std::memcpy(buffer.data() + sizeof(updated_record_size), updated_record.data(), updated_record_size); // Copy updated record data
-        size_t new_size = buffer.size();
+        if (oldKey == std::string()) {
+            std::cout << "Error: Get Key function gave an error" << std::endl;
+            return false;
+        }
+
+        uint32_t updated_record_size = static_cast<uint32_t>(updated_record.size());
+        size_t new_size = sizeof(updated_record_size) + updated_record_size;
 
         size_t used_space = header.slot_count * sizeof(uint16_t);
         size_t free_space = header.free_space_offset - used_space - sizeof(header); // Subtract header size and used space
 
-        if (updated_record_size <= record_size) {
-            page.seekp(page_num * PAGE_SIZE + slot_offset);
-            page.write(reinterpret_cast<const char*>(buffer.data()), new_size);
-            page.flush();
+        if (updated_record_size > record_size && free_space < new_size) {
+            std::cout << "Not enough space to update record." << std::endl;
+            return false;
         }
-        else if (free_space >= new_size) {
-            // If the updated record is larger, we need to find a new slot
-            uint16_t new_slot_offset = header.free_space_offset - new_size;
-            page.seekp(page_num * PAGE_SIZE + new_slot_offset);
-            page.write(reinterpret_cast<const char*>(buffer.data()), new_size);
 
-            // Update slot pointer
-            page.seekp(page_num * PAGE_SIZE + sizeof(PageHeader) + slot_num * sizeof(uint16_t));
-            page.write(reinterpret_cast<const char*>(&new_slot_offset), sizeof(new_slot_offset));
+        latches.undo.record(page_num, slot_num, std::move(old_record)); // scans that started before keep reading the old record
+
+        uint16_t new_slot_offset = slot_offset;
 
-            // Update the page header
-            page.seekp(page_num * PAGE_SIZE);
-            page.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (updated_record_size <= record_size) {
+            add_dead_space(latches, page_num, record_size - updated_record_size);
         }
         else {
-            std::cout << "Not enough space to update record." << std::endl;
-            return false;
+            add_dead_space(latches, page_num, sizeof(record_size) + record_size);
+
+            // If the updated record is larger, it moves to the free space and the slot points there
+            new_slot_offset = header.free_space_offset - new_size;
+            std::memcpy(slot, &new_slot_offset, sizeof(new_slot_offset));
+
+            header.free_space_offset = new_slot_offset;
+            std::memcpy(buffer.data(), &header, sizeof(header));
         }
+
+        std::memcpy(buffer.data() + new_slot_offset, &updated_record_size, sizeof(updated_record_size));
+        std::memcpy(buffer.data() + new_slot_offset + sizeof(updated_record_size), updated_record.data(), updated_record_size);
+
+        latches.dirty.stage(page_num, buffer);
     }
+    page_latch.unlock();
 
-	if (!is_vacuum) {
-        vacuum(table);
-	}
+    commit_pages(table, latches);
+
+    track_changes(table, &updated_record, 0);
 
 	std::string newKey = get_key(table, updated_record);
 
     if (oldKey != newKey) {
-        size_t old_hash = std::hash<std::string>{}(oldKey);
-        size_t bucket = old_hash % INDEX_BUCKET_SIZE;
-        auto& old_index = index_buckets[table][bucket];
-        
-		old_index.erase(std::remove(old_index.begin(), old_index.end(), record_id), old_index.end());
-
-        size_t new_hash = std::hash<std::string>{}(newKey);
-        size_t new_bucket = new_hash % INDEX_BUCKET_SIZE;
-		auto& new_index = index_buckets[table][new_bucket];
-        if (std::find(new_index.begin(), new_index.end(), record_id) == new_index.end()) {
-            // Only add if not already present
-            new_index.push_back(record_id);
-		}
-		save_index_buckets(table); // Save the index buckets to file
+        uint64_t version = move_in_index(table, oldKey, newKey, record_id, record_id);
+		persist_index(table, version); // Save the index buckets to file
 	}
 
     return true;
 }
 
-bool FileStorageLayer::delete_record(const std::string& table, int record_id) {
+size_t FileStorageLayer::update_where(
+    const std::string& table,
+    const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func,
+    const std::function<bool(std::vector<uint8_t>&)>& modify) {
+
+    counters.add(StorageCounter::UpdateWhereCalls);
+    StorageOperation operation(*this, LatencyOp::UpdateWhere, table);
+
     if (!is_open) {
-        std::cout << "Storage is not open. Cannot delete record." << std::endl;
-        return false;
-	}
+        std::cout << "Storage is not open. Cannot update records." << std::endl;
+        return 0;
+    }
+
+    auto latch = latch_table<SharedLatch>(table);
 
-    if (!is_table_exists(table)) {
+    if (!latch) {
         std::cout << "Table does not exist." << std::endl;
-        return false; 
-	}
+        return 0;
+    }
 
 	auto tableFile = std::filesystem::path(storage_path) / (table + ".db");
+	TableLatches& latches = *latch.latches;
+	uint64_t batch = latches.undo.begin_batch();
 
-    {
-        std::fstream page(tableFile, std::ios::binary | std::ios::in | std::ios::out);
-
-        if (!page.is_open()) {
-            std::cout << "Failed to open table file." << std::endl;
-            return false;
-        }
-
-        uint16_t page_num, slot_num;
-        split_record_id(record_id, page_num, slot_num);
+    size_t updated = 0;
+    uint64_t index_version = 0; // of the last index change
+    std::unordered_set<int> relocated; // new IDs of the records moved to another page, not updated again
 
-        if (page_num < 0 || slot_num < 0) {
-            std::cout << "Invalid record ID." << std::endl;
-            return false;
-        }
+    {
+        std::ifstream file;
 
-        PageHeader header;
-        page.seekg(page_num * PAGE_SIZE);
-        page.read(reinterpret_cast<char*>(&header), sizeof(header));
+        // pages appended meanwhile only hold records inserted after the update started
+        size_t num_pages = table_pages(table);
+        std::vector<uint8_t> buffer(PAGE_SIZE);
 
-        if (slot_num >= header.slot_count) {
-            std::cout << "Slot number out of bounds." << std::endl;
-            return false;
-        }
+        for (size_t page_num = 0; page_num < num_pages; ++page_num) {
+            std::unique_lock<std::shared_mutex> page_latch(latches.page(page_num));
+            if (!load_page(file, tableFile, latches, page_num, buffer)) {
+                std::cout << "Failed to read table file." << std::endl;
+                break;
+            }
 
-        uint16_t slot_position = page_num * PAGE_SIZE + sizeof(PageHeader) + slot_num * sizeof(uint16_t);
-        page.seekg(slot_position);
-        page.write(reinterpret_cast<const char*>(&DELETE_SLOT), sizeof(DELETE_SLOT)); // Mark slot as deleted
-        page.flush();
-    }
+            PageHeader header;
+            std::memcpy(&header, buffer.data(), sizeof(header));
+            bool dirty = false;
 
-    if (!is_vacuum) {
-        vacuum(table);
-    }
+            for (uint16_t slot_num = 0; slot_num < header.slot_count; slot_num++) {
+                uint8_t* slot = buffer.data() + sizeof(PageHeader) + slot_num * sizeof(uint16_t);
+                uint16_t slot_offset;
+                std::memcpy(&slot_offset, slot, sizeof(slot_offset));
 
-	// Remove the record ID from the index buckets
-    for (auto& index : index_buckets[table]) {
-        auto it = std::find(index.begin(), index.end(), record_id);
-        if (it != index.end()) {
-            index.erase(it);
-            save_index_buckets(table); 
-            break;
-        }
-	}
+                int record_id = make_record_id(page_num, slot_num);
 
-    return true;
-}
+                if (slot_offset == 0 || slot_offset == DELETE_SLOT || relocated.count(record_id)) {
+                    continue;
+                }
 
-std::vector<std::vector<uint8_t>> FileStorageLayer::scan(
-    const std::string& table,
-    const std::optional<std::function<bool(int, const std::vector<uint8_t>&)>>& callback,
-    const std::optional<std::vector<int>>& projection,
-    const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func) {
+                uint32_t record_size;
+                std::memcpy(&record_size, buffer.data() + slot_offset, sizeof(record_size));
 
-	std::vector<std::vector<uint8_t>> results;
+                auto record_start = buffer.begin() + slot_offset + sizeof(uint32_t);
+                std::vector<uint8_t> record(record_start, record_start + record_size);
 
-    if (!is_open) {
-        std::cout << "Storage is not open. Cannot scan table." << std::endl;
-        return results;
-	}
+                if (filter_func && !filter_func.value()(record)) {
+                    continue;
+                }
 
-    if (!is_table_exists(table)) {
-        std::cout << "Table does not exist." << std::endl;
-		return results;
-	}
+                std::vector<uint8_t> updated_record = record;
+                if (!modify(updated_record)) {
+                    continue;
+                }
 
-	auto tableFile = std::filesystem::path(storage_path) / (table + ".db");
-	std::ifstream page(tableFile, std::ios::binary);
+                std::string old_key = get_key(table, record);
+                std::string new_key = get_key(table, updated_record);
 
-    if (!page.is_open()) {
-        std::cout << "Failed to open table file." << std::endl;
-		return results;
-	}
+                uint32_t new_size = updated_record.size();
+                size_t used_space = header.slot_count * sizeof(uint16_t);
+                size_t free_space = header.free_space_offset - used_space - sizeof(header);
+                size_t needed = sizeof(uint32_t) + new_size;
 
-	size_t file_size = std::filesystem::file_size(tableFile);
-	size_t num_pages = file_size / PAGE_SIZE;
+                latches.undo.record_pending(batch, page_num, slot_num, record);
 
-    for (size_t page_num = 0; page_num < num_pages; ++page_num) {
-        PageHeader header;
-        page.seekg(page_num * PAGE_SIZE);
-        page.read(reinterpret_cast<char*>(&header), sizeof(header));
+                if (new_size <= record_size) {
+                    // Fits into the old space
+                    std::memcpy(buffer.data() + slot_offset, &new_size, sizeof(new_size));
+                    std::memcpy(buffer.data() + slot_offset + sizeof(uint32_t), updated_record.data(), new_size);
+                    add_dead_space(latches, page_num, record_size - new_size);
+                }
+                else if (free_space >= needed) {
+                    add_dead_space(latches, page_num, sizeof(uint32_t) + record_size);
 
-        for (uint16_t slot_num = 0; slot_num < header.slot_count; slot_num++) {
-			uint16_t slot_offset;
-            page.seekg(page_num * PAGE_SIZE + sizeof(PageHeader) + slot_num * sizeof(uint16_t));
-            page.read(reinterpret_cast<char*>(&slot_offset), sizeof(slot_offset));
-            
-            if (slot_offset == 0 || slot_offset == DELETE_SLOT) {
-                continue; // Skip empty or deleted slots
-            }
-            
-            // Read the record size
-            uint32_t record_size;
-            page.seekg(page_num * PAGE_SIZE + slot_offset);
-            page.read(reinterpret_cast<char*>(&record_size), sizeof(record_size));
-            
-            // Read the record data
-            std::vector<uint8_t> record_data(record_size);
-			page.read(reinterpret_cast<char*>(record_data.data()), record_size);
+                    // Moves to the free space of the same page, the record ID stays
+                    uint16_t new_offset = header.free_space_offset - needed;
+                    std::memcpy(buffer.data() + new_offset, &new_size, sizeof(new_size));
+                    std::memcpy(buffer.data() + new_offset + sizeof(uint32_t), updated_record.data(), new_size);
+                    std::memcpy(slot, &new_offset, sizeof(new_offset));
 
-            if (!page) {
-                continue;
-            }
+                    header.free_space_offset = new_offset;
+                    std::memcpy(buffer.data(), &header, sizeof(header));
+                }
+                else {
+                    // Does not fit into the page: moves to another page before the slot is freed, the index gets the
+                    // new record ID before it loses the old one
+                    int new_id = relocate_record(table, latches, page_num, updated_record, batch);
+                    if (new_id < 0) {
+                        continue;
+                    }
 
-            if (filter_func && !filter_func.value()(record_data)) {
-                continue;
-			}
+                    std::memcpy(slot, &DELETE_SLOT, sizeof(DELETE_SLOT));
+                    add_dead_space(latches, page_num, sizeof(uint32_t) + record_size);
+                    relocated.insert(new_id);
+                    index_version = move_in_index(table, old_key, new_key, record_id, new_id);
+                    track_changes(table, &updated_record, 0);
+                    dirty = true;
+                    updated++;
+                    continue;
+                }
 
-			int record_id = make_record_id(page_num, slot_num);
+                if (old_key != new_key) {
+                    index_version = move_in_index(table, old_key, new_key, record_id, record_id);
+                }
+                track_changes(table, &updated_record, 0);
 
-            if (callback && !callback.value()(record_id, record_data)) {
-                continue; // If callback returns false, skip this record
+                dirty = true;
+                updated++;
             }
 
-            // If projection is specified, filter the record data
-            if (projection) {
-                std::vector<uint8_t> projected_record;
-                for (int index : projection.value()) {
-                    if (index < 0 || index >= static_cast<int>(record_data.size())) {
-                        std::cout << "Projection index out of bounds." << std::endl;
-                        continue;
-                    }
-					projected_record.push_back(record_data[index]);
-                }
-				results.push_back(projected_record);
-            }
-            else {
-                results.push_back(record_data); // Add the full record data
+            if (dirty) {
+                latches.dirty.stage(page_num, buffer); // read by other calls once the latch is released
             }
         }
     }
 
-    return results;
+    if (index_version) {
+        persist_index(table, index_version);
+    }
+    commit_pages(table, latches);
+    latches.undo.commit(batch);
+
+    return updated;
 }
 
-bool FileStorageLayer::create_table(const std::string& table_name, const TableSchema& schema) {
+bool FileStorageLayer::delete_record(const std::string& table, int record_id) {
+    counters.add(StorageCounter::DeleteCalls);
+    StorageOperation operation(*this, LatencyOp::Delete, table);
+
     if (!is_open) {
-        std::cout << "Storage is not open. Cannot create table." << std::endl;
+        std::cout << "Storage is not open. Cannot delete record." << std::endl;
         return false;
-    }
+	}
 
-    auto tableFile = std::filesystem::path(storage_path) / (table_name + ".db");
-    auto schemaFile = std::filesystem::path(storage_path) / (table_name + ".schema");
+    auto latch = latch_table<SharedLatch>(table);
 
-    if (std::filesystem::exists(tableFile) || std::filesystem::exists(schemaFile)) {
-        std::cout << "Table with such name is already exists!" << std::endl;
+    if (!latch) {
+        std::cout << "Table does not exist." << std::endl;
         return false;
-    }
+	}
 
-    std::ofstream page(tableFile, std::ios::binary);
+	auto tableFile = std::filesystem::path(storage_path) / (table + ".db");
+	TableLatches& latches = *latch.latches;
 
-    PageHeader header{ 0, (uint16_t)PAGE_SIZE };
-	page.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	uint16_t page_num, slot_num;
+	split_record_id(record_id, page_num, slot_num);
+
+    if (record_id < 0 || page_num >= table_pages(table)) {
+        std::cout << "Invalid record ID." << std::endl;
+        return false;
+    }
+
+	std::string key;
+
+    {
+        // Only the slot is marked, the vacuum worker reclaims the space
+        std::unique_lock<std::shared_mutex> page_latch(latches.page(page_num));
+        std::ifstream file;
+
+        std::vector<uint8_t> buffer(PAGE_SIZE);
+        if (!load_page(file, tableFile, latches, page_num, buffer)) {
+            std::cout << "Failed to read table file." << std::endl;
+            return false;
+        }
+
+        PageHeader header;
+        std::memcpy(&header, buffer.data(), sizeof(header));
+
+        if (slot_num >= header.slot_count) {
+            std::cout << "Slot number out of bounds." << std::endl;
+            return false;
+        }
+
+        uint8_t* slot = buffer.data() + sizeof(PageHeader) + slot_num * sizeof(uint16_t);
+        uint16_t slot_offset;
+        std::memcpy(&slot_offset, slot, sizeof(slot_offset));
+
+        if (slot_offset == 0 || slot_offset == DELETE_SLOT || slot_offset + sizeof(uint32_t) > PAGE_SIZE) {
+            return false;
+        }
+
+        uint32_t record_size;
+        std::memcpy(&record_size, buffer.data() + slot_offset, sizeof(record_size));
+
+        if (slot_offset + sizeof(record_size) + record_size > PAGE_SIZE) {
+            return false;
+        }
+
+        auto record_start = buffer.begin() + slot_offset + sizeof(record_size);
+        std::vector<uint8_t> record(record_start, record_start + record_size);
+        key = get_key(table, record);
+
+        latches.undo.record(page_num, slot_num, std::move(record)); // scans that started before still see the record
+        std::memcpy(slot, &DELETE_SLOT, sizeof(DELETE_SLOT)); // Mark slot as deleted
+        add_dead_space(latches, page_num, sizeof(record_size) + record_size);
+
+        latches.dirty.stage(page_num, buffer);
+    }
+
+    commit_pages(table, latches);
+
+    track_changes(table, nullptr, -1);
+
+    latches.index.remove(latches.index.bucket_of(key), record_id);
+    uint64_t version = ++latches.index_version;
+    persist_index(table, version);
+
+    return true;
+}
+
+size_t FileStorageLayer::delete_many(const std::string& table, const std::vector<int>& record_ids) {
+    counters.add(StorageCounter::DeleteManyCalls);
+    StorageOperation operation(*this, LatencyOp::DeleteMany, table);
+
+    if (!is_open) {
+        std::cout << "Storage is not open. Cannot delete record." << std::endl;
+        return 0;
+	}
+
+    auto latch = latch_table<SharedLatch>(table);
+
+    if (!latch) {
+        std::cout << "Table does not exist." << std::endl;
+        return 0;
+	}
+
+	auto tableFile = std::filesystem::path(storage_path) / (table + ".db");
+	TableLatches& latches = *latch.latches;
+	uint64_t batch = latches.undo.begin_batch();
+
+	// Sorted record IDs are grouped by page, so every page is read and written once
+	std::vector<int> sorted_ids(record_ids);
+	std::sort(sorted_ids.begin(), sorted_ids.end());
+	sorted_ids.erase(std::unique(sorted_ids.begin(), sorted_ids.end()), sorted_ids.end());
+
+	std::unordered_set<int> deleted_ids;
+
+    {
+        std::ifstream file;
+
+        size_t num_pages = table_pages(table);
+        std::vector<uint8_t> buffer(PAGE_SIZE);
+        size_t i = 0;
+
+        while (i < sorted_ids.size()) {
+            uint16_t page_num, slot_num;
+            split_record_id(sorted_ids[i], page_num, slot_num);
+
+            if (sorted_ids[i] < 0 || page_num >= num_pages) {
+                std::cout << "Invalid record ID." << std::endl;
+                i++;
+                continue;
+            }
+
+            std::unique_lock<std::shared_mutex> page_latch(latches.page(page_num));
+            if (!load_page(file, tableFile, latches, page_num, buffer)) {
+                std::cout << "Failed to read table file." << std::endl;
+                break;
+            }
+
+            PageHeader header;
+            std::memcpy(&header, buffer.data(), sizeof(header));
+
+            bool dirty = false;
+
+            for (; i < sorted_ids.size(); i++) {
+                uint16_t id_page;
+                split_record_id(sorted_ids[i], id_page, slot_num);
+
+                if (id_page != page_num) {
+                    break;
+                }
+
+                if (slot_num >= header.slot_count) {
+                    std::cout << "Slot number out of bounds." << std::endl;
+                    continue;
+                }
+
+                uint8_t* slot = buffer.data() + sizeof(PageHeader) + slot_num * sizeof(uint16_t);
+                uint16_t slot_offset;
+                std::memcpy(&slot_offset, slot, sizeof(slot_offset));
+
+                if (slot_offset == 0 || slot_offset == DELETE_SLOT || slot_offset + sizeof(uint32_t) > PAGE_SIZE) {
+                    continue;
+                }
+
+                uint32_t record_size;
+                std::memcpy(&record_size, buffer.data() + slot_offset, sizeof(record_size));
+
+                if (slot_offset + sizeof(record_size) + record_size > PAGE_SIZE) {
+                    continue;
+                }
+
+                auto record_start = buffer.begin() + slot_offset + sizeof(uint32_t);
+                latches.undo.record_pending(batch, page_num, slot_num, std::vector<uint8_t>(record_start, record_start + record_size));
+
+                std::memcpy(slot, &DELETE_SLOT, sizeof(DELETE_SLOT)); // Mark slot as deleted
+                add_dead_space(latches, page_num, sizeof(record_size) + record_size);
+                deleted_ids.insert(sorted_ids[i]);
+                dirty = true;
+            }
+
+            if (dirty) {
+                latches.dirty.stage(page_num, buffer); // read by other calls once the latch is released
+            }
+        }
+    }
+
+    commit_pages(table, latches);
+    latches.undo.commit(batch);
+
+    if (deleted_ids.empty()) {
+        return 0;
+    }
+
+    track_changes(table, nullptr, -(int64_t)deleted_ids.size());
+
+	// Remove the record IDs from the index buckets in a single pass
+    latches.index.remove_many(deleted_ids);
+    uint64_t version = ++latches.index_version;
+    persist_index(table, version);
+
+    return deleted_ids.size();
+}
+
+std::vector<std::vector<uint8_t>> FileStorageLayer::scan(
+    const std::string& table,
+    const std::optional<std::function<bool(int, const std::vector<uint8_t>&)>>& callback,
+    const std::optional<std::vector<int>>& projection,
+    const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func) {
+
+	std::vector<std::vector<uint8_t>> results;
+	counters.add(StorageCounter::ScanCalls);
+	StorageOperation operation(*this, LatencyOp::Scan, table);
+	TraceSpan span("scan", "scan");
+	span.arg("table", table);
+
+    if (!is_open) {
+        std::cout << "Storage is not open. Cannot scan table." << std::endl;
+        return results;
+	}
+
+    auto latch = latch_table<SharedLatch>(table);
+
+    if (!latch) {
+        std::cout << "Table does not exist." << std::endl;
+		return results;
+	}
+
+    // Pages are read whole under their latch, the callback runs after the latch is released.
+    // Pages appended after the snapshot only hold records it does not see.
+    UndoLog::Snapshot snapshot(latch.latches->undo);
+    scan_pages(table, 0, table_pages(table), [&](int record_id, const std::vector<uint8_t>& record_data) {
+        if (callback && !callback.value()(record_id, record_data)) {
+            return true; // If callback returns false, skip this record
+        }
+
+        // If projection is specified, filter the record data
+        if (projection) {
+            std::vector<uint8_t> projected_record;
+            for (int index : projection.value()) {
+                if (index < 0 || index >= static_cast<int>(record_data.size())) {
+                    std::cout << "Projection index out of bounds." << std::endl;
+                    continue;
+                }
+                projected_record.push_back(record_data[index]);
+            }
+            results.push_back(projected_record);
+        }
+        else {
+            results.push_back(record_data); // Add the full record data
+        }
+        return true;
+    }, filter_func, snapshot.timestamp());
+
+    return results;
+}
+
+void FileStorageLayer::scan_while(
+    const std::string& table,
+    const std::function<bool(int, const std::vector<uint8_t>&)>& visit,
+    const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func) {
+
+    counters.add(StorageCounter::ScanCalls);
+    StorageOperation operation(*this, LatencyOp::Scan, table);
+    TraceSpan span("scan_while", "scan");
+    span.arg("table", table);
+
+    if (!is_open) {
+        std::cout << "Storage is not open. Cannot scan table." << std::endl;
+        return;
+    }
+
+    auto latch = latch_table<SharedLatch>(table);
+
+    if (!latch) {
+        std::cout << "Table does not exist." << std::endl;
+        return;
+    }
+
+    UndoLog::Snapshot snapshot(latch.latches->undo);
+    scan_pages(table, 0, table_pages(table), visit, filter_func, snapshot.timestamp());
+}
+
+std::vector<std::vector<uint8_t>> FileStorageLayer::parallel_scan(
+    const std::string& table,
+    const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func) {
+
+    std::vector<std::vector<std::vector<uint8_t>>> worker_results(scan_workers());
+
+    parallel_visit(table, [&](size_t worker, int, const std::vector<uint8_t>& record) {
+        worker_results[worker].push_back(record);
+    }, filter_func);
+
+    // workers own ascending page ranges, so concatenating keeps the page order
+    std::vector<std::vector<uint8_t>> results;
+    for (auto& worker : worker_results) {
+        for (auto& record : worker) {
+            results.push_back(std::move(record));
+        }
+    }
+
+    return results;
+}
+
+void FileStorageLayer::parallel_visit(
+    const std::string& table,
+    const std::function<void(size_t, int, const std::vector<uint8_t>&)>& visit,
+    const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func) {
+
+    counters.add(StorageCounter::ParallelScanCalls);
+    StorageOperation operation(*this, LatencyOp::ParallelScan, table);
+    TraceSpan span("parallel_scan", "scan");
+    span.arg("table", table);
+
+    if (!is_open) {
+        std::cout << "Storage is not open. Cannot scan table." << std::endl;
+        return;
+    }
+
+    auto latch = latch_table<SharedLatch>(table);
+
+    if (!latch) {
+        std::cout << "Table does not exist." << std::endl;
+        return;
+    }
+
+    UndoLog::Snapshot snapshot(latch.latches->undo); // shared by the workers
+    size_t num_pages = table_pages(table);
+    size_t workers = scan_workers();
+    size_t pages_per_worker = (num_pages + workers - 1) / workers;
+
+    std::vector<std::future<void>> done;
+
+    for (size_t worker = 0; worker < workers; worker++) {
+        size_t first_page = worker * pages_per_worker;
+        size_t last_page = std::min(num_pages, first_page + pages_per_worker);
+
+        if (first_page >= last_page) {
+            break;
+        }
+
+        done.push_back(scan_pool->submit([this, &table, &visit, &filter_func, &snapshot, worker, first_page, last_page]() {
+            scan_pages(table, first_page, last_page, [&](int record_id, const std::vector<uint8_t>& record) {
+                visit(worker, record_id, record);
+                return true;
+            }, filter_func, snapshot.timestamp());
+        }));
+    }
+
+    // wait for every worker before rethrowing, they reference the caller's state
+    for (auto& worker : done) {
+        worker.wait();
+    }
+    for (auto& worker : done) {
+        worker.get();
+    }
+}
+
+void FileStorageLayer::set_scan_threads(size_t threads) {
+    scan_pool = std::make_unique<ThreadPool>(threads);
+}
+
+size_t FileStorageLayer::scan_workers() const {
+    return scan_pool->size();
+}
+
+bool FileStorageLayer::create_table(const std::string& table_name, const TableSchema& schema) {
+    if (!is_open) {
+        std::cout << "Storage is not open. Cannot create table." << std::endl;
+        return false;
+    }
+
+    auto tableFile = std::filesystem::path(storage_path) / (table_name + ".db");
+    auto schemaFile = std::filesystem::path(storage_path) / (table_name + ".schema");
+
+    std::unique_lock<std::shared_mutex> catalog(catalog_latch);
+
+    if (std::filesystem::exists(tableFile) || std::filesystem::exists(schemaFile)) {
+        std::cout << "Table with such name is already exists!" << std::endl;
+        return false;
+    }
+
+    std::ofstream page(tableFile, std::ios::binary);
+    counters.add(StorageCounter::FileOpens);
+
+    PageHeader header{ 0, (uint16_t)PAGE_SIZE };
+	write_at(page, 0, &header, sizeof(header));
+    counters.add(StorageCounter::PagesWritten);
+
+    if (!page) {
+        std::cout << "Failed to create table file." << std::endl;
+        return false;
+    }
+
+	std::ofstream schema_page(schemaFile);
+
+    if (!schema_page.is_open()) {
+        std::cout << "Failed to create schema file." << std::endl;
+        return false;
+    }
+
+    schema_page << schema.columns.size() << std::endl; // Write the number of columns
+
+    for (const auto& column : schema.columns) {
+        schema_page << column.name << " " 
+                    << static_cast<int>(column.type) << " " 
+                    << column.length << std::endl; // Write column name, type, and length
+    }
+
+	table_schemas[table_name] = schema; // Store the schema for the table
+	table_latches[table_name] = std::make_shared<TableLatches>();
+	publish_table_latches();
+	return true;
+}
+
+bool FileStorageLayer::drop_table(const std::string& table_name) {
+    if (!is_open) {
+        std::cout << "Storage is not open. Cannot drop table." << std::endl;
+        return false;
+    }
+    auto tableFile = std::filesystem::path(storage_path) / (table_name + ".db");
+	auto schemaFile = std::filesystem::path(storage_path) / (table_name + ".schema");
+	auto indexFile = std::filesystem::path(storage_path) / (table_name + ".index");
+
+    // waits for the running calls on the table, later ones find it gone
+    auto latch = latch_table<ExclusiveLatch>(table_name);
+
+    if (!latch || !std::filesystem::exists(tableFile)) {
+        std::cout << "Table with such name does not exist!" << std::endl;
+        return false;
+    }
+
+    std::filesystem::remove(tableFile);
+	std::filesystem::remove(schemaFile); // Remove the schema file as well
+	std::filesystem::remove(indexFile); // Remove the index file if it exists
+
+	std::filesystem::remove(std::filesystem::path(storage_path) / (table_name + ".stats"));
+
+    {
+        std::unique_lock<std::shared_mutex> catalog(catalog_latch);
+        table_schemas.erase(table_name); // Remove the schema from the in-memory map
+        table_stats.erase(table_name);
+        table_latches.erase(table_name);
+        publish_table_latches();
+    }
+
+	std::cout << "Table " << table_name << " dropped successfully." << std::endl;
+	return true;
+}
+
+std::vector<std::string> FileStorageLayer::list_tables() {
+    if (!is_open) {
+        std::cout << "Storage is not open. Cannot list tables." << std::endl;
+        return {};
+    }
+    std::vector<std::string> tables;
+    for (const auto& entry : std::filesystem::directory_iterator(storage_path)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".db") {
+            tables.push_back(entry.path().stem().string());
+        }
+    }
+    return tables;
+}
+
+void FileStorageLayer::vacuum_loop() {
+    auto next_page = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(vacuum_mutex);
+
+    while (!vacuum_wake.wait_for(lock, vacuum_config.interval, [&] { return vacuum_stop; })) {
+        if (!vacuum_config.enabled) {
+            continue;
+        }
+        VacuumSettings settings = vacuum_config;
+        lock.unlock();
+
+        std::vector<std::string> tables;
+        {
+            std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+            for (auto& table : table_latches) {
+                tables.push_back(table.first);
+            }
+        }
+
+        bool stopped = false;
+        for (size_t i = 0; i < tables.size() && !stopped; i++) {
+            size_t dead = dead_bytes(tables[i]);
+            size_t table_bytes = page_count(tables[i]) * PAGE_SIZE;
+
+            if (dead > 0 && dead >= settings.min_dead_bytes && dead >= settings.dead_fraction * table_bytes) {
+                stopped = !vacuum(tables[i], settings, next_page);
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+bool FileStorageLayer::vacuum(const std::string& table_name, const VacuumSettings& settings, std::chrono::steady_clock::time_point& next_page) {
+    std::vector<std::pair<size_t, size_t>> pages; // page and dead bytes, most dead space first
+    {
+        auto latch = latch_table<SharedLatch>(table_name, false);
+        if (!latch) {
+            return true;
+        }
+        std::lock_guard<std::mutex> dead_latch(latch.latches->dead_space);
+        pages.assign(latch.latches->dead_pages.begin(), latch.latches->dead_pages.end());
+    }
+    std::sort(pages.begin(), pages.end(), [](auto& a, auto& b) { return a.second > b.second; });
+
+    auto tableFile = std::filesystem::path(storage_path) / (table_name + ".db");
+    std::ifstream file;
+    std::vector<uint8_t> buffer(PAGE_SIZE);
+    size_t compacted = 0;
+
+    for (auto& [page_num, dead] : pages) {
+        if (settings.pages_per_second > 0) {
+            std::unique_lock<std::mutex> lock(vacuum_mutex);
+            if (vacuum_wake.wait_until(lock, next_page, [&] { return vacuum_stop; })) {
+                return false;
+            }
+            next_page = std::max(next_page, std::chrono::steady_clock::now())
+                + std::chrono::microseconds(1000000 / settings.pages_per_second);
+        }
+
+        // Foreground calls never wait for the worker: a page or table that is in use is left for a later pass.
+        // The table latch is taken per page, so a drop or analyze waits for one page at most.
+        auto latch = latch_table<SharedLatch>(table_name, false);
+        if (!latch) {
+            break;
+        }
+        TableLatches& latches = *latch.latches;
+        std::unique_lock<std::shared_mutex> page_latch(latches.page(page_num), std::try_to_lock);
+        if (!page_latch.owns_lock()) {
+            continue;
+        }
+
+        StorageOperation operation(*this, LatencyOp::Vacuum, table_name);
+        TraceSpan span("vacuum", "storage");
+        span.arg("table", table_name);
+        span.arg("page", (int64_t)page_num);
+
+        if (!load_page(file, tableFile, latches, page_num, buffer)) {
+            std::cout << "Failed to read table file during vacuum." << std::endl;
+            return true;
+        }
+
+        // Records keep their slots, so record IDs, the index and the versions of running scans stay valid
+        if (compact_page(buffer) > 0) {
+            latches.dirty.stage(page_num, buffer); // written back by the page writer
+            counters.add(StorageCounter::PagesVacuumed);
+            compacted++;
+        }
+
+        std::lock_guard<std::mutex> dead_latch(latches.dead_space);
+        auto page_dead = latches.dead_pages.find(page_num);
+        if (page_dead != latches.dead_pages.end()) {
+            latches.dead_bytes -= page_dead->second;
+            latches.dead_pages.erase(page_dead);
+        }
+    }
+
+    if (compacted > 0) {
+        counters.add(StorageCounter::VacuumRuns);
+    }
+    return true;
+}
+
+void FileStorageLayer::add_dead_space(TableLatches& latches, size_t page_num, size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> dead_latch(latches.dead_space);
+    latches.dead_pages[page_num] += bytes;
+    latches.dead_bytes += bytes;
+}
+
+void FileStorageLayer::set_vacuum_settings(const VacuumSettings& settings) {
+    {
+        std::lock_guard<std::mutex> lock(vacuum_mutex);
+        vacuum_config = settings;
+    }
+    vacuum_wake.notify_all();
+}
+
+VacuumSettings FileStorageLayer::vacuum_settings() const {
+    std::lock_guard<std::mutex> lock(vacuum_mutex);
+    return vacuum_config;
+}
+
+void FileStorageLayer::page_writer_loop() {
+    std::unique_lock<std::mutex> lock(page_writer_mutex);
+
+    while (!page_writer_wake.wait_for(lock, write_back_config.interval, [&] { return page_writer_stop; })) {
+        lock.unlock();
+
+        std::vector<std::string> tables;
+        {
+            std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+            for (auto& table : table_latches) {
+                tables.push_back(table.first);
+            }
+        }
+
+        for (auto& table : tables) {
+            // a table held exclusively (analyze, a bulk load) is written back in a later interval
+            auto latch = latch_table<SharedLatch>(table, false);
+            if (!latch) {
+                continue;
+            }
+            TableLatches& latches = *latch.latches;
+
+            if (latches.dirty.count() > 0) {
+                write_back(table, latches);
+            }
+
+            // index changes of Async writes, saved after the pages they point to
+            write_index(table, latches.index_version);
+        }
+
+        lock.lock();
+    }
+}
+
+// Flush the OS cache of the file to the disk
+static bool sync_file(std::FILE* file) {
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+size_t FileStorageLayer::write_back(const std::string& table_name, TableLatches& latches) {
+    std::lock_guard<std::mutex> lock(latches.write_back);
+
+    // a Sync call whose pages an earlier write-back took finds nothing left to write
+    auto pages = latches.dirty.collect();
+    if (pages.empty()) {
+        return 0;
+    }
+
+    StorageOperation operation(*this, LatencyOp::WriteBack, table_name);
+    TraceSpan span("write_back", "storage");
+    span.arg("table", table_name);
+    span.arg("pages", (int64_t)pages.size());
+
+    auto tableFile = std::filesystem::path(storage_path) / (table_name + ".db");
+    std::FILE* file = std::fopen(tableFile.string().c_str(), "r+b");
+    counters.add(StorageCounter::FileOpens);
+
+    if (!file) {
+        std::cout << "Failed to open table file for write-back." << std::endl;
+        return 0;
+    }
+
+    std::vector<uint8_t> run;
+    auto page = pages.begin();
+
+    while (page != pages.end()) {
+        // Adjacent pages are written with one sequential write
+        size_t first_page = page->first;
+        run.clear();
+
+        while (page != pages.end() && page->first == first_page + run.size() / PAGE_SIZE && run.size() < WRITE_BACK_RUN_PAGES * PAGE_SIZE) {
+            run.insert(run.end(), page->second->begin(), page->second->end());
+            ++page;
+        }
+
+        std::fseek(file, (long)(first_page * PAGE_SIZE), SEEK_SET);
+        size_t written = std::fwrite(run.data(), 1, run.size(), file);
+        counters.add(StorageCounter::WriteCalls);
+        counters.add(StorageCounter::BytesWritten, written);
+        counters.add(StorageCounter::PagesWritten, run.size() / PAGE_SIZE);
+
+        if (written != run.size()) {
+            std::cout << "Failed to write table file, the pages stay dirty." << std::endl;
+            std::fclose(file);
+            return 0;
+        }
+    }
+
+    bool synced = std::fflush(file) == 0 && sync_file(file);
+    counters.add(StorageCounter::Flushes);
+    counters.add(StorageCounter::Fsyncs);
+    counters.add(StorageCounter::WriteBacks);
+    std::fclose(file);
+
+    if (!synced) {
+        std::cout << "Failed to sync table file, the pages stay dirty." << std::endl;
+        return 0;
+    }
+
+    // readers find the pages in the file from here on
+    latches.dirty.written(pages);
+    return pages.size();
+}
+
+void FileStorageLayer::commit_pages(const std::string& table_name, TableLatches& latches) {
+    WriteBackSettings settings = write_back_settings();
+
+    if (settings.durability == Durability::Sync || latches.dirty.count() > settings.max_dirty_pages) {
+        write_back(table_name, latches);
+    }
+}
+
+bool FileStorageLayer::load_page(std::ifstream& file, const std::filesystem::path& path, TableLatches& latches, size_t page_num, std::vector<uint8_t>& page) {
+    if (latches.dirty.read(page_num, page)) {
+        return true;
+    }
+
+    if (!file.is_open()) {
+        file.open(path, std::ios::binary);
+        counters.add(StorageCounter::FileOpens);
+
+        if (!file.is_open()) {
+            std::cout << "Failed to open table file." << std::endl;
+            return false;
+        }
+    }
+    return read_page(file, page_num, page);
+}
+
+bool FileStorageLayer::load_page_header(std::ifstream& file, const std::filesystem::path& path, TableLatches& latches, size_t page_num, PageHeader& header) {
+    if (latches.dirty.read(page_num, &header, sizeof(header))) {
+        return true;
+    }
+
+    if (!file.is_open()) {
+        // unbuffered, a buffered stream would fill its whole buffer after every seek for the few header bytes
+        file.rdbuf()->pubsetbuf(nullptr, 0);
+        file.open(path, std::ios::binary);
+        counters.add(StorageCounter::FileOpens);
+
+        if (!file.is_open()) {
+            std::cout << "Failed to open table file." << std::endl;
+            return false;
+        }
+    }
+    counters.add(StorageCounter::PagesRead);
+    return read_at(file, page_num * PAGE_SIZE, &header, sizeof(header));
+}
+
+void FileStorageLayer::set_write_back_settings(const WriteBackSettings& settings) {
+    {
+        std::lock_guard<std::mutex> lock(page_writer_mutex);
+        write_back_config = settings;
+    }
+    page_writer_wake.notify_all();
+}
+
+WriteBackSettings FileStorageLayer::write_back_settings() const {
+    std::lock_guard<std::mutex> lock(page_writer_mutex);
+    return write_back_config;
+}
+
+size_t FileStorageLayer::dirty_pages(const std::string& table_name) const {
+    std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+    auto latches = table_latches.find(table_name);
+    return latches != table_latches.end() ? latches->second->dirty.count() : 0;
+}
+
+size_t FileStorageLayer::dead_bytes(const std::string& table_name) const {
+    std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+    auto latches = table_latches.find(table_name);
+    return latches != table_latches.end() ? latches->second->dead_bytes.load() : 0;
+}
+
+std::vector<int> FileStorageLayer::find(const std::string& table_name, const std::string& key) {
+    counters.add(StorageCounter::FindCalls);
+    StorageOperation operation(*this, LatencyOp::Find, table_name);
+
+    if (!is_open) {
+        std::cout << "Storage is not open. Cannot find records." << std::endl;
+        return {};
+    }
+
+    // neither the catalog nor the table is latched, the published map and the bucket are read under the guard
+    EpochGuard guard;
+    const TableLatchMap* tables = published_latches.load();
+
+    auto latches = tables ? tables->find(table_name) : TableLatchMap::const_iterator();
+    if (!tables || latches == tables->end()) {
+        std::cout << "Table does not exist." << std::endl;
+        return {};
+    }
+    return latches->second->index.find(key);
+}
+
+size_t FileStorageLayer::page_count(const std::string& table_name) const {
+    auto latch = latch_table<SharedLatch>(table_name);
+    return latch ? table_pages(table_name) : 0;
+}
+
+size_t FileStorageLayer::table_pages(const std::string& table_name) const {
+    if (!is_table_exists(table_name)) {
+        return 0;
+    }
+    auto tableFile = std::filesystem::path(storage_path) / (table_name + ".db");
+    size_t file_pages = std::filesystem::file_size(tableFile) / PAGE_SIZE;
+
+    // appended pages are in the file once the page writer has written them back
+    return std::max(file_pages, latches_of(table_name).dirty.end_page());
+}
+
+int FileStorageLayer::relocate_record(const std::string& table, TableLatches& latches, size_t held_page, const std::vector<uint8_t>& record, uint64_t batch) {
+    if (sizeof(PageHeader) + sizeof(uint16_t) + sizeof(uint32_t) + record.size() > PAGE_SIZE) {
+        std::cout << "Record does not fit into a page." << std::endl;
+        return -1;
+    }
+
+    auto tableFile = std::filesystem::path(storage_path) / (table + ".db");
+    std::ifstream file;
+    std::vector<uint8_t> buffer(PAGE_SIZE);
+
+    size_t num_pages = table_pages(table);
+
+    for (size_t page_num = 0; ; ++page_num) {
+        if (page_num == held_page) {
+            continue;
+        }
+
+        if (page_num >= num_pages) {
+            std::lock_guard<std::mutex> append(latches.append);
+            num_pages = table_pages(table);
+
+            if (page_num >= num_pages) {
+                init_page(buffer);
+                latches.dirty.stage(page_num, buffer);
+                num_pages = page_num + 1;
+            }
+        }
 
-    if (!page) {
-        std::cout << "Failed to create table file." << std::endl;
+        // the held latch also covers the pages of its stripe
+        std::unique_lock<std::shared_mutex> page_latch;
+        if (&latches.page(page_num) != &latches.page(held_page)) {
+            page_latch = std::unique_lock<std::shared_mutex>(latches.page(page_num), std::try_to_lock);
+            if (!page_latch.owns_lock()) {
+                continue;
+            }
+        }
+
+        PageHeader header;
+        if (!load_page_header(file, tableFile, latches, page_num, header)) {
+            std::cout << "Failed to read table file." << std::endl;
+            return -1;
+        }
+        if (!record_fits(header, record.size())) {
+            continue;
+        }
+
+        if (!load_page(file, tableFile, latches, page_num, buffer)) {
+            std::cout << "Failed to read table file." << std::endl;
+            return -1;
+        }
+        int slot = place_record(buffer, record);
+
+        latches.undo.record_pending(batch, page_num, slot, std::nullopt);
+        latches.dirty.stage(page_num, buffer); // readers find the record before the index has its ID
+        return make_record_id(page_num, slot);
+    }
+}
+
+bool FileStorageLayer::analyze(const std::string& table_name) {
+    counters.add(StorageCounter::AnalyzeCalls);
+
+    if (!is_open) {
+        std::cout << "Storage is not open. Cannot analyze table." << std::endl;
         return false;
     }
 
-	std::ofstream schema_page(schemaFile);
+    // exclusive, the statistics are replaced and writers adjust them
+    auto latch = latch_table<ExclusiveLatch>(table_name);
 
-    if (!schema_page.is_open()) {
-        std::cout << "Failed to create schema file." << std::endl;
+    if (!latch) {
+        std::cout << "Table does not exist." << std::endl;
         return false;
     }
 
-    schema_page << schema.columns.size() << std::endl; // Write the number of columns
+    size_t num_pages = table_pages(table_name);
+    size_t sampled_pages = std::min(num_pages, (size_t)STATS_SAMPLE_PAGES);
+    std::vector<std::vector<uint8_t>> sample;
+
+    // Whole pages spread evenly over the table, every record of a sampled page is used
+    for (size_t i = 0; i < sampled_pages; i++) {
+        size_t page_num = i * num_pages / sampled_pages;
+        scan_pages(table_name, page_num, page_num + 1, [&](int, const std::vector<uint8_t>& record) {
+            sample.push_back(record);
+            return true;
+        }, std::nullopt);
+    }
 
-    for (const auto& column : schema.columns) {
-        schema_page << column.name << " " 
-                    << static_cast<int>(column.type) << " " 
-                    << column.length << std::endl; // Write column name, type, and length
+    TableStats stats = build_table_stats(get_table_schema(table_name), sample, sampled_pages, num_pages);
+
+    if (!save_table_stats(storage_path + "/" + table_name + ".stats", stats)) {
+        std::cout << "Failed to write statistics file." << std::endl;
+        return false;
     }
 
-	table_schemas[table_name] = schema; // Store the schema for the table
-	return true;
+    std::unique_lock<std::shared_mutex> catalog(catalog_latch);
+    table_stats[table_name] = std::move(stats);
+    return true;
 }
 
-bool FileStorageLayer::drop_table(const std::string& table_name) {
-    if (!is_open) {
-        std::cout << "Storage is not open. Cannot drop table." << std::endl;
-        return false;
+std::optional<TableStats> FileStorageLayer::get_table_stats(const std::string& table_name) const {
+    auto latch = latch_table<SharedLatch>(table_name);
+    if (!latch) {
+        return std::nullopt;
     }
-    auto tableFile = std::filesystem::path(storage_path) / (table_name + ".db");
-	auto schemaFile = std::filesystem::path(storage_path) / (table_name + ".schema");
-	auto indexFile = std::filesystem::path(storage_path) / (table_name + ".index");
-    
-    if (!std::filesystem::exists(tableFile)) {
-        std::cout << "Table with such name does not exist!" << std::endl;
-        return false;
+
+    const TableStats* stats;
+    {
+        std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+        auto it = table_stats.find(table_name);
+        if (it == table_stats.end()) {
+            return std::nullopt;
+        }
+        stats = &it->second;
     }
 
-    std::filesystem::remove(tableFile);
-	std::filesystem::remove(schemaFile); // Remove the schema file as well
-	std::filesystem::remove(indexFile); // Remove the index file if it exists
+    std::lock_guard<std::mutex> stats_latch(latch.latches->stats);
+    return *stats;
+}
 
-	table_schemas.erase(table_name); // Remove the schema from the in-memory map
-    index_buckets.erase(table_name); // Remove the index buckets for the table
+StorageStats FileStorageLayer::counters_snapshot() const {
+    return counters.snapshot();
+}
 
-	std::cout << "Table " << table_name << " dropped successfully." << std::endl;
-	return true;
+void FileStorageLayer::reset_counters() {
+    counters.reset();
 }
 
-std::vector<std::string> FileStorageLayer::list_tables() {
-    if (!is_open) {
-        std::cout << "Storage is not open. Cannot list tables." << std::endl;
-        return {};
-    }
+LatencyHistograms& FileStorageLayer::latencies() {
+    return latency;
+}
+
+const LatencyHistograms& FileStorageLayer::latencies() const {
+    return latency;
+}
+
+MemoryTracker& FileStorageLayer::memory() {
+    return query_memory;
+}
+
+SlowQueryLog& FileStorageLayer::slow_log() {
+    return slow_queries;
+}
+
+static size_t string_heap_bytes(const std::string& text) {
+    return text.capacity() > std::string().capacity() ? text.capacity() + 1 : 0;
+}
+
+static size_t value_heap_bytes(const Value& value) {
+    auto text = std::get_if<std::string>(&value);
+    return text ? string_heap_bytes(*text) : 0;
+}
+
+MemoryUsage FileStorageLayer::memory_usage() const {
+    MemoryUsage usage;
+    usage.query_bytes = query_memory.used();
+    usage.query_peak_bytes = query_memory.peak();
+    usage.limit_bytes = query_memory.limit();
+
     std::vector<std::string> tables;
-    for (const auto& entry : std::filesystem::directory_iterator(storage_path)) {
-        if (entry.is_regular_file() && entry.path().extension() == ".db") {
-            tables.push_back(entry.path().stem().string());
+    {
+        std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+        for (auto& index : table_schemas) {
+            tables.push_back(index.first);
         }
     }
-    return tables;
-}
 
-bool FileStorageLayer::vacuum(const std::string& table_name) {
+    for (auto& table_name : tables) {
+        // the index and statistics change under the table, bucket and stats latches, the catalog is only locked to find them
+        auto latch = latch_table<SharedLatch>(table_name);
+        if (!latch) {
+            continue;
+        }
+
+        const TableSchema* table_schema;
+        const TableStats* table_stats_entry = nullptr;
+        {
+            std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+            table_schema = &table_schemas.at(table_name);
 
-    if (is_vacuum) {
-        return true;
-	}
-	is_vacuum = true;
+            auto stats = table_stats.find(table_name);
+            if (stats != table_stats.end()) {
+                table_stats_entry = &stats->second;
+            }
+        }
 
-    if (!is_open) {
-        std::cout << "Storage is not open. Cannot vacuum table." << std::endl;
-        return false;
-    }
+        TableMemory table;
+        table.table = table_name;
 
-    if (!is_table_exists(table_name)) {
-        std::cout << "Table does not exist." << std::endl;
-        return false;
-    }
+        const TableSchema& schema = *table_schema;
 
-	// Read all records from the table
-	auto records = scan(table_name);
-	auto tableFile = std::filesystem::path(storage_path) / (table_name + ".db");
+        table.schema_bytes = sizeof(TableSchema) + schema.columns.capacity() * sizeof(Column);
+        for (auto& column : schema.columns) {
+            table.schema_bytes += string_heap_bytes(column.name);
+        }
 
-	std::filesystem::remove(tableFile); // Remove the old table file
+        table.index_bytes = latch.latches->index.memory_bytes();
 
-    std::ofstream new_page(tableFile, std::ios::binary);
-    if (!new_page.is_open()) {
-        std::cout << "Failed to create new table file." << std::endl;
-        return false;
+        table.undo_bytes = latch.latches->undo.memory_bytes();
+
+        table.dirty_bytes = latch.latches->dirty.memory_bytes();
+
+        std::lock_guard<std::mutex> stats_latch(latch.latches->stats);
+        if (table_stats_entry) {
+            table.stats_bytes = sizeof(TableStats) + table_stats_entry->columns.capacity() * sizeof(ColumnStats);
+            for (auto& column : table_stats_entry->columns) {
+                table.stats_bytes += (1 << HLL_PRECISION) + column.histogram.capacity() * sizeof(Value);
+                for (auto& bound : column.histogram) {
+                    table.stats_bytes += value_heap_bytes(bound);
+                }
+                table.stats_bytes += column.min ? value_heap_bytes(*column.min) : 0;
+                table.stats_bytes += column.max ? value_heap_bytes(*column.max) : 0;
+            }
+        }
+
+        usage.tables.push_back(std::move(table));
     }
 
-	PageHeader header{ 0, (uint16_t)PAGE_SIZE };
-	new_page.write(reinterpret_cast<const char*>(&header), sizeof(header));
-	new_page.close();
+    std::sort(usage.tables.begin(), usage.tables.end(), [](auto& a, auto& b) { return a.table < b.table; });
+    return usage;
+}
 
-    for (const auto& record : records) {
-        if (insert(table_name, record) == -1) {
-            std::cout << "Failed to insert record during vacuum." << std::endl;
-            return false;
+// PRIVATE METHODS
+
+template<class Latch>
+Latch FileStorageLayer::latch_table(const std::string& table, bool wait) const {
+    while (true) {
+        std::shared_ptr<TableLatches> latches;
+        {
+            std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+            auto it = table_latches.find(table);
+            if (it == table_latches.end()) {
+                return {};
+            }
+            latches = it->second;
+        }
+
+        decltype(Latch::lock) lock(latches->table, std::defer_lock);
+        if (wait) {
+            lock.lock();
+        }
+        else if (!lock.try_lock()) {
+            return {};
         }
+
+        // the table may have been dropped (and created again) while waiting
+        std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+        auto it = table_latches.find(table);
+        if (it == table_latches.end()) {
+            return {};
+        }
+        if (it->second == latches) {
+            return { std::move(latches), std::move(lock) };
+        }
+    }
+}
+
+void FileStorageLayer::publish_table_latches() {
+    const TableLatchMap* old = published_latches.exchange(new TableLatchMap(table_latches));
+    if (old) {
+        EpochManager::instance().retire(old);
     }
+}
 
-	is_vacuum = false;
-	return true;
+HashIndex& FileStorageLayer::table_index(const std::string& table_name) {
+    return latches_of(table_name).index;
 }
 
-std::vector<int> FileStorageLayer::find(const std::string& table_name, const std::string& key) {
-    if (!is_open) {
-        std::cout << "Storage is not open. Cannot find records." << std::endl;
-        return {};
+FileStorageLayer::TableLatches& FileStorageLayer::latches_of(const std::string& table_name) const {
+    std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+    return *table_latches.at(table_name);
+}
+
+void FileStorageLayer::persist_index(const std::string& table_name, uint64_t version) {
+    if (write_back_settings().durability == Durability::Async) {
+        return; // saved by the page writer with the dirty pages
     }
-    if (!is_table_exists(table_name)) {
-        std::cout << "Table does not exist." << std::endl;
-        return {};
+    write_index(table_name, version);
+}
+
+void FileStorageLayer::write_index(const std::string& table_name, uint64_t version) {
+    TableLatches& latches = latches_of(table_name);
+    std::lock_guard<std::mutex> lock(latches.index_file);
+
+    if (latches.saved_version >= version) {
+        return; // written by a save that started after the change
     }
-    size_t hash_value = std::hash<std::string>{}(key);
-    size_t bucket = hash_value % INDEX_BUCKET_SIZE;
-	return index_buckets[table_name][bucket];
+
+    uint64_t saving = latches.index_version;
+    save_index_buckets(table_name);
+    latches.saved_version = saving;
 }
 
-// PRIVATE METHODS
+uint64_t FileStorageLayer::move_in_index(const std::string& table_name, const std::string& old_key, const std::string& new_key, int old_id, int new_id) {
+    TableLatches& latches = latches_of(table_name);
+    latches.index.move(latches.index.bucket_of(old_key), latches.index.bucket_of(new_key), old_id, new_id);
+    return ++latches.index_version;
+}
+
+bool FileStorageLayer::read_page(std::istream& file, size_t page_num, std::vector<uint8_t>& page) {
+    counters.add(StorageCounter::PagesRead);
+    return read_at(file, page_num * PAGE_SIZE, page.data(), PAGE_SIZE);
+}
+
+void FileStorageLayer::write_page(std::ostream& file, size_t page_num, const std::vector<uint8_t>& page) {
+    counters.add(StorageCounter::PagesWritten);
+    write_at(file, page_num * PAGE_SIZE, page.data(), PAGE_SIZE);
+}
+
+bool FileStorageLayer::read_at(std::istream& file, size_t offset, void* data, size_t size) {
+    file.seekg(offset);
+    file.read(reinterpret_cast<char*>(data), size);
+    counters.add(StorageCounter::ReadCalls);
+    counters.add(StorageCounter::BytesRead, file.gcount());
+    return (bool)file;
+}
+
+void FileStorageLayer::write_at(std::ostream& file, size_t offset, const void* data, size_t size) {
+    file.seekp(offset);
+    file.write(reinterpret_cast<const char*>(data), size);
+    counters.add(StorageCounter::WriteCalls);
+    counters.add(StorageCounter::BytesWritten, size);
+}
 
 void FileStorageLayer::ensure_directory_exists(const std::string& path) {
 	std::filesystem::create_directory(path);
@@ -633,6 +1840,156 @@ bool FileStorageLayer::is_table_exists(const std::string& table_name) const {
     return std::filesystem::exists(tableFile);
 }
 
+bool FileStorageLayer::scan_pages(
+    const std::string& table,
+    size_t first_page,
+    size_t last_page,
+    const std::function<bool(int, const std::vector<uint8_t>&)>& visit,
+    const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func,
+    std::optional<uint64_t> snapshot) {
+
+    TraceSpan span("scan_pages", "scan");
+    span.arg("table", table);
+    span.arg("first_page", (int64_t)first_page);
+    span.arg("last_page", (int64_t)last_page);
+
+    auto tableFile = std::filesystem::path(storage_path) / (table + ".db");
+    std::ifstream page;
+    std::vector<uint8_t> buffer(PAGE_SIZE);
+    TableLatches& latches = latches_of(table);
+    std::unordered_map<uint16_t, std::optional<std::vector<uint8_t>>> versions; // records the snapshot sees differently
+
+    for (size_t page_num = first_page; page_num < last_page; ++page_num) {
+        // Read the whole page at once instead of seeking to every slot, the page latch is only held for the read
+        std::shared_lock<std::shared_mutex> page_latch(latches.page(page_num));
+        if (!load_page(page, tableFile, latches, page_num, buffer)) {
+            break;
+        }
+        if (snapshot) {
+            versions = latches.undo.visible(page_num, *snapshot);
+        }
+        page_latch.unlock();
+
+        PageHeader header;
+        std::memcpy(&header, buffer.data(), sizeof(header));
+
+        for (uint16_t slot_num = 0; slot_num < header.slot_count; slot_num++) {
+            auto version = versions.find(slot_num);
+            if (version != versions.end()) {
+                if (version->second && (!filter_func || filter_func.value()(*version->second))) {
+                    if (!visit(make_record_id(page_num, slot_num), *version->second)) {
+                        return false;
+                    }
+                }
+                continue;
+            }
+
+            uint16_t slot_offset;
+            std::memcpy(&slot_offset, buffer.data() + sizeof(PageHeader) + slot_num * sizeof(uint16_t), sizeof(slot_offset));
+
+            if (slot_offset == 0 || slot_offset == DELETE_SLOT || slot_offset + sizeof(uint32_t) > PAGE_SIZE) {
+                continue; // Skip empty or deleted slots
+            }
+
+            uint32_t record_size;
+            std::memcpy(&record_size, buffer.data() + slot_offset, sizeof(record_size));
+
+            if (slot_offset + sizeof(uint32_t) + record_size > PAGE_SIZE) {
+                continue;
+            }
+
+            auto record_start = buffer.begin() + slot_offset + sizeof(uint32_t);
+            std::vector<uint8_t> record_data(record_start, record_start + record_size);
+
+            if (filter_func && !filter_func.value()(record_data)) {
+                continue;
+            }
+
+            if (!visit(make_record_id(page_num, slot_num), record_data)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void FileStorageLayer::init_page(std::vector<uint8_t>& page) {
+    std::fill(page.begin(), page.end(), 0);
+    PageHeader header{ 0, (uint16_t)PAGE_SIZE };
+    std::memcpy(page.data(), &header, sizeof(header));
+}
+
+int FileStorageLayer::place_record(std::vector<uint8_t>& page, const std::vector<uint8_t>& record) {
+    PageHeader header;
+    std::memcpy(&header, page.data(), sizeof(header));
+
+    if (!record_fits(header, record.size())) {
+        return -1;
+    }
+
+    size_t needed = sizeof(uint32_t) + record.size(); // record size prefix and data
+    uint16_t new_data = header.free_space_offset - needed;
+    uint32_t record_size = record.size();
+    std::memcpy(page.data() + new_data, &record_size, sizeof(record_size));
+    std::memcpy(page.data() + new_data + sizeof(record_size), record.data(), record.size());
+
+    uint16_t slot = header.slot_count;
+    std::memcpy(page.data() + sizeof(PageHeader) + slot * sizeof(uint16_t), &new_data, sizeof(new_data));
+
+    header.slot_count++;
+    header.free_space_offset = new_data;
+    std::memcpy(page.data(), &header, sizeof(header));
+
+    return slot;
+}
+
+bool FileStorageLayer::record_fits(const PageHeader& header, size_t record_size) {
+    size_t used_space = header.slot_count * sizeof(uint16_t);
+    size_t free_space = header.free_space_offset - used_space - sizeof(header);
+    return free_space >= sizeof(uint32_t) + record_size + sizeof(uint16_t);
+}
+
+size_t FileStorageLayer::compact_page(std::vector<uint8_t>& page) {
+    PageHeader header;
+    std::memcpy(&header, page.data(), sizeof(header));
+
+    std::vector<uint8_t> packed(PAGE_SIZE, 0);
+    size_t directory_end = sizeof(PageHeader) + header.slot_count * sizeof(uint16_t);
+    uint16_t free_space_offset = PAGE_SIZE;
+
+    for (uint16_t slot_num = 0; slot_num < header.slot_count; slot_num++) {
+        uint8_t* slot = page.data() + sizeof(PageHeader) + slot_num * sizeof(uint16_t);
+        uint16_t slot_offset;
+        std::memcpy(&slot_offset, slot, sizeof(slot_offset));
+
+        if (slot_offset != 0 && slot_offset != DELETE_SLOT) {
+            uint32_t record_size;
+            std::memcpy(&record_size, page.data() + slot_offset, sizeof(record_size));
+            size_t length = sizeof(record_size) + record_size;
+
+            if (slot_offset + length > PAGE_SIZE || length > free_space_offset - directory_end) {
+                return 0; // damaged page, left as it is
+            }
+
+            free_space_offset -= length;
+            std::memmove(packed.data() + free_space_offset, page.data() + slot_offset, length);
+            slot_offset = free_space_offset;
+        }
+        std::memcpy(packed.data() + sizeof(PageHeader) + slot_num * sizeof(uint16_t), &slot_offset, sizeof(slot_offset));
+    }
+
+    if (free_space_offset <= header.free_space_offset) {
+        return 0;
+    }
+
+    size_t reclaimed = free_space_offset - header.free_space_offset;
+    header.free_space_offset = free_space_offset;
+    std::memcpy(packed.data(), &header, sizeof(header));
+    page.swap(packed);
+    return reclaimed;
+}
+
 int FileStorageLayer::make_record_id(uint16_t page, uint16_t slot) const {
     // Combine page and slot into a single record ID
     // Assuming page and slot are both 16-bit integers
@@ -672,7 +2029,32 @@ void FileStorageLayer::load_table_schemas() {
 	}
 }
 
+void FileStorageLayer::track_changes(const std::string& table_name, const std::vector<uint8_t>* record, int64_t row_delta) {
+    TableStats* found;
+    TableLatches* latches;
+    {
+        std::shared_lock<std::shared_mutex> catalog(catalog_latch);
+        auto it = table_stats.find(table_name);
+        if (it == table_stats.end()) {
+            return; // only analyzed tables have statistics
+        }
+        found = &it->second; // stays valid, it is only erased under the table latch the caller holds
+        latches = table_latches.at(table_name).get();
+    }
+
+    TableSchema schema = get_table_schema(table_name);
+    std::lock_guard<std::mutex> stats_latch(latches->stats); // concurrent writers of the table adjust the same statistics
+    TableStats& stats = *found;
+    stats.row_count = (uint64_t)std::max<int64_t>(0, (int64_t)stats.row_count + row_delta);
+    stats.modified_rows += row_delta < 0 ? (uint64_t)(-row_delta) : 1;
+
+    if (record) {
+        update_table_stats(stats, schema, *record);
+    }
+}
+
 TableSchema FileStorageLayer::get_table_schema(const std::string& table_name) const {
+    std::shared_lock<std::shared_mutex> catalog(catalog_latch);
     auto it = table_schemas.find(table_name);
     if (it != table_schemas.end()) {
         return it->second;
@@ -682,14 +2064,19 @@ TableSchema FileStorageLayer::get_table_schema(const std::string& table_name) co
 
 void FileStorageLayer::load_index_buckets(const std::string& table_name)
 {
+    TraceSpan span("load_index", "index");
+    span.arg("table", table_name);
+
     std::ifstream index_page(storage_path + "/" + table_name + ".index");
-    auto& buckets = index_buckets[table_name];
-    buckets.assign(INDEX_BUCKET_SIZE, {});
+    HashIndex& index = table_index(table_name);
+    counters.add(StorageCounter::IndexLoads);
+    counters.add(StorageCounter::FileOpens);
+    std::vector<std::vector<int>> buckets(index.bucket_count());
 
     std::string line;
     size_t bucket_cout = 0;
 
-    while (std::getline(index_page, line) && bucket_cout < INDEX_BUCKET_SIZE) {
+    while (std::getline(index_page, line) && bucket_cout < buckets.size()) {
         std::stringstream ss(line);
         std::string token;
         while (std::getline(ss, token, ',')) {
@@ -700,15 +2087,22 @@ void FileStorageLayer::load_index_buckets(const std::string& table_name)
         }
 
         bucket_cout++;
+        counters.add(StorageCounter::BytesRead, line.size() + 1);
     }
+
+    index.assign(buckets);
 }
 
 void FileStorageLayer::save_index_buckets(const std::string& table_name)
 {
+    TraceSpan span("save_index", "index");
+    span.arg("table", table_name);
+
     std::ofstream index_page(storage_path + "/" + table_name + ".index", std::ios::trunc);
-    auto& buckets = index_buckets[table_name];
+    HashIndex& index = table_index(table_name);
 
-    for (auto& bucket : buckets) {
+    for (size_t bucket_num = 0; bucket_num < index.bucket_count(); bucket_num++) {
+        std::vector<int> bucket = index.bucket(bucket_num);
         for (size_t i = 0; i < bucket.size(); i++) {
             if (i) {
                 index_page << ',';
@@ -718,6 +2112,9 @@ void FileStorageLayer::save_index_buckets(const std::string& table_name)
         index_page << "\n";
     }
 
+    counters.add(StorageCounter::IndexSaves);
+    counters.add(StorageCounter::FileOpens);
+    counters.add(StorageCounter::BytesWritten, std::max<std::streamoff>(0, index_page.tellp()));
 }
 
 std::string FileStorageLayer::get_key(const std::string& table_name, const std::vector<uint8_t>& record)
@@ -757,4 +2154,105 @@ std::string FileStorageLayer::get_key(const std::string& table_name, const std::
         std::cout << "Unsupported data type for indexing." << std::endl;
         return std::string(); // Unsupported data type for indexing
     }
-}
\ No newline at end of file
+}
+
+// BULK LOADER
+
+BulkLoader::BulkLoader(FileStorageLayer& storage, const std::string& table)
+    : storage(storage), table(table), page(PAGE_SIZE), page_num(0), loaded(0), finished(false),
+      latch(storage.latch_table<FileStorageLayer::ExclusiveLatch>(table)) {
+
+    if (!storage.is_open || !latch) {
+        std::cout << "Cannot bulk load: storage is not open or table does not exist." << std::endl;
+        finished = true;
+        return;
+    }
+
+    // the loaded pages go to the file directly, after the pages that are still dirty
+    storage.write_back(table, *latch.latches);
+
+    auto tableFile = std::filesystem::path(storage.storage_path) / (table + ".db");
+    file.open(tableFile, std::ios::binary | std::ios::in | std::ios::out);
+    storage.counters.add(StorageCounter::FileOpens);
+
+    if (!file.is_open()) {
+        std::cout << "Failed to open table file." << std::endl;
+        finished = true;
+        return;
+    }
+
+    // New pages start after the last full page, an empty table starts at page 0
+    page_num = storage.table_pages(table);
+    FileStorageLayer::init_page(page);
+}
+
+BulkLoader::~BulkLoader() {
+    if (!finished) {
+        finish();
+    }
+}
+
+bool BulkLoader::append(const std::vector<uint8_t>& record) {
+    if (finished) {
+        return false;
+    }
+
+    // a record that fits no page would only flush the current page early
+    if (sizeof(PageHeader) + sizeof(uint16_t) + sizeof(uint32_t) + record.size() > PAGE_SIZE) {
+        std::cout << "Record does not fit into a page." << std::endl;
+        return false;
+    }
+
+    int slot = FileStorageLayer::place_record(page, record);
+
+    if (slot < 0) {
+        write_page();
+        page_num++;
+        FileStorageLayer::init_page(page);
+        slot = FileStorageLayer::place_record(page, record);
+    }
+
+    std::string key = storage.get_key(table, record);
+    index_entries.emplace_back(storage.table_index(table).bucket_of(key), storage.make_record_id(page_num, slot));
+    storage.track_changes(table, &record, 1);
+
+    loaded++;
+    return true;
+}
+
+size_t BulkLoader::finish() {
+    if (finished) {
+        return loaded;
+    }
+    finished = true;
+
+    write_page();
+    file.close();
+    storage.counters.add(StorageCounter::BulkLoads);
+
+    if (storage.write_back_settings().durability == Durability::Sync) {
+        // the file stream can not fsync, the loaded pages are synced through a handle of their own
+        auto tableFile = std::filesystem::path(storage.storage_path) / (table + ".db");
+        std::FILE* synced_file = std::fopen(tableFile.string().c_str(), "r+b");
+        storage.counters.add(StorageCounter::FileOpens);
+
+        if (!synced_file || !sync_file(synced_file)) {
+            std::cout << "Failed to sync table file." << std::endl;
+        }
+        storage.counters.add(StorageCounter::Fsyncs);
+
+        if (synced_file) {
+            std::fclose(synced_file);
+        }
+    }
+
+    storage.table_index(table).add_many(index_entries);
+    storage.save_index_buckets(table);
+    latch.lock.unlock();
+
+    return loaded;
+}
+
+void BulkLoader::write_page() {
+    storage.write_page(file, page_num, page);
+}
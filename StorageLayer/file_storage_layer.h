@@ -6,19 +6,71 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <unordered_set>
 #include "storage_layer.h"
+#include "thread_pool.h"
 #include "table_schema.h"
+#include "table_stats.h"
+#include "storage_counters.h"
+#include "latency_histogram.h"
+#include "memory_tracker.h"
+#include "slow_query_log.h"
+#include "undo_log.h"
+#include "hash_index.h"
+#include "dirty_pages.h"
 
 static const int PAGE_SIZE = 4096; // Size of a page in bytes
 static const uint16_t DELETE_SLOT = 0xFFFF; // Special value to indicate a deleted slot
 static const int INDEX_BUCKET_SIZE = 1024; // size of each index bucket in bytes
+static const int PAGE_LATCH_STRIPES = 64; // page latches per table, page n uses latch n % PAGE_LATCH_STRIPES
+static const size_t WRITE_BACK_RUN_PAGES = 64; // adjacent dirty pages written back with one write
+
+// When and how fast the background vacuum worker compacts pages
+struct VacuumSettings {
+	bool enabled = true;
+	size_t min_dead_bytes = 16 * PAGE_SIZE; // a table is vacuumed once it has this much dead space
+	double dead_fraction = 0.1; // and this fraction of its pages is dead
+	size_t pages_per_second = 200; // I/O budget, every compacted page is read and written once; 0 for no limit
+	std::chrono::milliseconds interval{ 500 }; // between checks of the dead space counters
+};
+
+// When a write call's pages reach the disk
+enum class Durability {
+	Sync, // written back and fsynced before the call returns
+	Async, // left to the background page writer, a crash loses the writes of the last interval
+};
+
+struct WriteBackSettings {
+	Durability durability = Durability::Sync;
+	std::chrono::milliseconds interval{ 100 }; // between write-backs of the page writer
+	size_t max_dirty_pages = 1024; // per table, a write call that leaves more writes the table back itself
+};
 
 struct PageHeader {
 	uint16_t slot_count; // Number of slots in the page
 	uint16_t free_space_offset; // Offset to the next free space in the page
 };
 
-
+/**
+ * Tables in slotted page files with a hash index on the first column.
+ * Safe to call from many threads. Reads and writes share the table latch and latch the pages they touch, so writers
+ * on different pages of one table run in parallel. Scans read a snapshot of the table: the before images of the
+ * writes made since the scan started are kept in the undo log of the table, and batch writes (insert_many,
+ * update_where, delete_many) become visible to scans at once. analyze and BulkLoader hold the table latch
+ * exclusively. Dead space of deleted and shrunk records is reclaimed by a background vacuum worker, which
+ * compacts one page at a time under its page latch. Changed pages are staged in memory and written back to the
+ * table file, by the calling write when the durability is Sync and by a background page writer when it is Async;
+ * adjacent pages go out in one write. open, close and set_scan_threads must not run concurrently
+ * with other calls. Scan callbacks run while the table latch is shared and must not call the storage layer for
+ * the scanned table.
+ */
 class FileStorageLayer : public StorageLayer {
 public:
     FileStorageLayer();
@@ -36,6 +88,27 @@ public:
         const std::optional<std::vector<int>>& projection = std::nullopt,
         const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func = std::nullopt) override;
 
+    // Visit records in page order until visit returns false, the rest of the table is not read
+    void scan_while(
+        const std::string& table,
+        const std::function<bool(int, const std::vector<uint8_t>&)>& visit,
+        const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func = std::nullopt);
+
+    // Scan with the page range split across the worker pool, results are merged in page order
+    std::vector<std::vector<uint8_t>> parallel_scan(
+        const std::string& table,
+        const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func = std::nullopt);
+
+    // Visit records from the worker threads, worker is in [0, scan_workers()) so callers can keep per-worker state.
+    // The calling thread holds the table latch until every worker is done.
+    void parallel_visit(
+        const std::string& table,
+        const std::function<void(size_t, int, const std::vector<uint8_t>&)>& visit,
+        const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func = std::nullopt);
+
+    void set_scan_threads(size_t threads);
+    size_t scan_workers() const;
+
     bool create_table(const std::string& table_name, const TableSchema& schema);
     bool drop_table(const std::string& table_name);
     std::vector<std::string> list_tables();
@@ -43,26 +116,260 @@ public:
     TableSchema get_table_schema(const std::string& table_name) const;
 
     std::vector<int> find(const std::string& table_name, const std::string& key);
+
+    // Insert a batch of records in a single pass over the pages with one index persist, returns record IDs in input order
+    std::vector<int> insert_many(const std::string& table, const std::vector<std::vector<uint8_t>>& records);
+
+    // Update matching records in a single pass over the pages. modify changes the record and returns false to keep it unchanged.
+    // Records are rewritten in place when they fit, the index is only touched when the indexed column changes.
+    size_t update_where(
+        const std::string& table,
+        const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func,
+        const std::function<bool(std::vector<uint8_t>&)>& modify);
+
+    // Delete a batch of records: slots are marked dead page by page and the index is updated in one pass
+    size_t delete_many(const std::string& table, const std::vector<int>& record_ids);
+
+    size_t page_count(const std::string& table_name) const;
+
+    // Sample the pages of the table and store its statistics in <table>.stats
+    bool analyze(const std::string& table_name);
+
+    // Statistics of an analyzed table, kept up to date by later writes
+    std::optional<TableStats> get_table_stats(const std::string& table_name) const;
+
+    // I/O and call counters since the layer was created or last reset
+    StorageStats counters_snapshot() const;
+    void reset_counters();
+
+    // Latency histograms of the storage operations and of the SQL statements run by QueryExecutor,
+    // written to <path>/latency.json on close
+    LatencyHistograms& latencies();
+    const LatencyHistograms& latencies() const;
+
+    // Query intermediate results are reserved here, with an optional limit
+    MemoryTracker& memory();
+
+    // Bytes of the index, schema and statistics of every table and of the running queries
+    MemoryUsage memory_usage() const;
+
+    // Storage calls and SQL statements slower than its threshold are appended to it, off until opened
+    SlowQueryLog& slow_log();
+
+    // Settings of the background vacuum worker, which runs while the storage is open
+    void set_vacuum_settings(const VacuumSettings& settings);
+    VacuumSettings vacuum_settings() const;
+
+    // Bytes of deleted and shrunk records not reclaimed yet, counted since the storage was opened
+    size_t dead_bytes(const std::string& table_name) const;
+
+    // Durability of the write calls and settings of the background page writer, which runs while the storage is open
+    void set_write_back_settings(const WriteBackSettings& settings);
+    WriteBackSettings write_back_settings() const;
+
+    // Pages of the table changed in memory and not written to its file yet
+    size_t dirty_pages(const std::string& table_name) const;
 private:
-    bool is_open;
-	bool is_vacuum;
+    friend class BulkLoader;
+
+    // Latches, index and undo log of one table. Page latches are striped, pages with the same stripe share a latch.
+    struct TableLatches {
+        std::shared_mutex table; // shared by page-level calls, exclusive for calls that rewrite the table
+        std::shared_mutex pages[PAGE_LATCH_STRIPES];
+        std::mutex append; // held while a page is added at the end of the file
+        std::mutex stats;
+        UndoLog undo; // versions of the recent writes for the scans of the table
+        HashIndex index{ INDEX_BUCKET_SIZE }; // lookups take no latch of their own, writers latch the bucket
+        DirtyPages dirty; // staged under the page latch, read before the table file
+        std::mutex write_back; // held by the write-back of the dirty pages, so an older image never overwrites a newer one
+
+        // Dead bytes per page, added by writers under the page latch and reset when the vacuum worker compacts the page
+        std::mutex dead_space;
+        std::unordered_map<size_t, size_t> dead_pages;
+        std::atomic<size_t> dead_bytes{ 0 };
+
+        // Index persists are grouped: a writer bumps index_version after changing a bucket and skips the save
+        // when a save that started later has already written it
+        std::mutex index_file;
+        std::atomic<uint64_t> index_version{ 0 };
+        std::atomic<uint64_t> saved_version{ 0 };
+
+        std::shared_mutex& page(size_t page_num) {
+            return pages[page_num % PAGE_LATCH_STRIPES];
+        }
+    };
+
+    // A held table latch, empty when the table does not exist. Keeps the latches alive when the table is dropped meanwhile.
+    template<class Lock>
+    struct TableLatch {
+        std::shared_ptr<TableLatches> latches;
+        Lock lock;
+
+        explicit operator bool() const {
+            return lock.owns_lock();
+        }
+    };
+    using SharedLatch = TableLatch<std::shared_lock<std::shared_mutex>>;
+    using ExclusiveLatch = TableLatch<std::unique_lock<std::shared_mutex>>;
+
+    std::atomic<bool> is_open;
     std::string storage_path;
 
+    // Guards the table maps themselves (lookups, create and drop). It is the innermost latch: never held while
+    // waiting for a table, page, bucket or stats latch. The index and statistics of a table are guarded by its latches.
+    mutable std::shared_mutex catalog_latch;
+    using TableLatchMap = std::unordered_map<std::string, std::shared_ptr<TableLatches>>;
+    TableLatchMap table_latches;
+
+    // Copy of table_latches for find(), read under an EpochGuard without any latch. It is replaced whenever a table is
+    // added or removed and the old copy is retired to the EpochManager, so a dropped table lives until its lookups end.
+    std::atomic<const TableLatchMap*> published_latches{ nullptr };
+
 	std::unordered_map<std::string, TableSchema> table_schemas;
-	std::unordered_map<std::string, std::vector<std::vector<int>>> index_buckets;
+	std::unordered_map<std::string, TableStats> table_stats;
+
+    std::unique_ptr<ThreadPool> scan_pool;
+    StorageCounters counters;
+    LatencyHistograms latency;
+    MemoryTracker query_memory;
+    SlowQueryLog slow_queries;
+
+    std::thread vacuum_thread;
+    mutable std::mutex vacuum_mutex;
+    std::condition_variable vacuum_wake;
+    bool vacuum_stop = false;
+    VacuumSettings vacuum_config;
+
+    std::thread page_writer_thread;
+    mutable std::mutex page_writer_mutex;
+    std::condition_variable page_writer_wake;
+    bool page_writer_stop = false;
+    WriteBackSettings write_back_config;
+
+    // Empty if the table does not exist, or without wait if the latch is held by another call
+    template<class Latch>
+    Latch latch_table(const std::string& table, bool wait = true) const;
+
+    // Publish a copy of table_latches to find(), the caller holds the catalog latch exclusively
+    void publish_table_latches();
+
+    // Hash index of a table, the caller holds its table latch
+    HashIndex& table_index(const std::string& table_name);
+
+    // Latches of an existing table, the caller holds its table latch
+    TableLatches& latches_of(const std::string& table_name) const;
+
+    // Save the index unless a save that started after the change with this index version has written it.
+    // With Async durability the page writer saves it instead.
+    void persist_index(const std::string& table_name, uint64_t version);
+    void write_index(const std::string& table_name, uint64_t version);
+
+    // Move a record ID from the bucket of its old key to the bucket of its new key (none if new_id is negative).
+    // The caller holds the table latch. Returns the index version of the change.
+    uint64_t move_in_index(const std::string& table_name, const std::string& old_key, const std::string& new_key, int old_id, int new_id);
+
+    // Unlatched parts of the public calls, for the calls that already hold the table latch
+    std::vector<uint8_t> read_record(const std::string& table, int record_id);
+    std::vector<int> insert_records(const std::string& table, const std::vector<std::vector<uint8_t>>& records, uint64_t batch);
+    size_t table_pages(const std::string& table_name) const;
+
+    // Place a record that no longer fits into its page on another page while the caller keeps that page latched.
+    // Other pages are only tried, so no latch is waited for. Returns the new record ID or -1.
+    int relocate_record(const std::string& table, TableLatches& latches, size_t held_page, const std::vector<uint8_t>& record, uint64_t batch);
+
+    // Body of the vacuum worker: checks the dead space of every table and vacuums the tables over the thresholds
+    void vacuum_loop();
+
+    // Compact the pages of the table with dead records within the page budget, skipping pages and tables other calls
+    // hold. Returns false when the worker is stopped meanwhile.
+    bool vacuum(const std::string& table_name, const VacuumSettings& settings, std::chrono::steady_clock::time_point& next_page);
+
+    // Body of the page writer: writes back the dirty pages of every table each interval
+    void page_writer_loop();
 
-    bool vacuum(const std::string& table_name);
+    // Write the dirty pages of the table to its file, runs of adjacent pages with one write each, and fsync it.
+    // The caller holds the table latch. Returns the number of pages written.
+    size_t write_back(const std::string& table_name, TableLatches& latches);
+
+    // End of a write call: writes the dirty pages back when the durability is Sync or the table has too many of them.
+    // The caller holds the table latch but no page latch.
+    void commit_pages(const std::string& table_name, TableLatches& latches);
+
+    // Page as the last write left it, from the dirty pages or the file, which is opened on the first page read from it.
+    // The caller holds the page latch.
+    bool load_page(std::ifstream& file, const std::filesystem::path& path, TableLatches& latches, size_t page_num, std::vector<uint8_t>& page);
+
+    // Header of the page as load_page would see it, only the header is read from the file. Probes use it to skip full pages.
+    bool load_page_header(std::ifstream& file, const std::filesystem::path& path, TableLatches& latches, size_t page_num, PageHeader& header);
+
+    // Count dead bytes on a page, the caller holds the page latch exclusively
+    void add_dead_space(TableLatches& latches, size_t page_num, size_t bytes);
+
+    // Returns false when visit returned false and the scan stopped early
+    bool scan_pages(
+        const std::string& table,
+        size_t first_page,
+        size_t last_page,
+        const std::function<bool(int, const std::vector<uint8_t>&)>& visit,
+        const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func,
+        std::optional<uint64_t> snapshot = std::nullopt);
+
+	// Counted stream I/O: whole pages, and partial reads and writes at a file offset
+	bool read_page(std::istream& file, size_t page_num, std::vector<uint8_t>& page);
+	void write_page(std::ostream& file, size_t page_num, const std::vector<uint8_t>& page);
+	bool read_at(std::istream& file, size_t offset, void* data, size_t size);
+	void write_at(std::ostream& file, size_t offset, const void* data, size_t size);
 
 	void ensure_directory_exists(const std::string& path);
 	bool is_table_exists(const std::string& table_name) const;
 
+	// Slotted page helpers working on an in-memory page buffer
+	static void init_page(std::vector<uint8_t>& page);
+	static int place_record(std::vector<uint8_t>& page, const std::vector<uint8_t>& record); // returns slot or -1 if the page is full
+	static bool record_fits(const PageHeader& header, size_t record_size); // free space for the record and its slot
+	static size_t compact_page(std::vector<uint8_t>& page); // packs the live records, slots stay; returns the reclaimed bytes
+
 	int make_record_id(uint16_t page, uint16_t slot) const;
 	void split_record_id(int record_id, uint16_t& page, uint16_t& slot);
 
 	void load_table_schemas();
+
+	// Adjust the statistics of an analyzed table for a written record and the change of the row count
+	void track_changes(const std::string& table_name, const std::vector<uint8_t>* record, int64_t row_delta);
      
 	void load_index_buckets(const std::string& table_name);
     void save_index_buckets(const std::string& table_name);
     std::string get_key(const std::string& table_name, const std::vector<uint8_t>& record);
 };
 
+/**
+ * Streams records into a table by filling whole pages in memory and appending them after the last page.
+ * Index entries are collected and added to the table index once, in finish().
+ */
+class BulkLoader {
+public:
+    BulkLoader(FileStorageLayer& storage, const std::string& table);
+    ~BulkLoader();
+
+    BulkLoader(const BulkLoader&) = delete;
+    BulkLoader& operator=(const BulkLoader&) = delete;
+
+    // Returns false if the record can not be stored
+    bool append(const std::vector<uint8_t>& record);
+
+    // Write the last page and persist the index, returns the number of loaded records
+    size_t finish();
+
+private:
+    FileStorageLayer& storage;
+    std::string table;
+    std::fstream file;
+    std::vector<uint8_t> page;
+    uint16_t page_num;
+    size_t loaded;
+    bool finished;
+    std::vector<std::pair<size_t, int>> index_entries; // bucket and record ID
+    FileStorageLayer::ExclusiveLatch latch; // held until finish()
+
+    void write_page();
+};
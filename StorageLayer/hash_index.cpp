@@ -0,0 +1,132 @@
+#include "hash_index.h"
+#include <algorithm>
+#include <functional>
+#include <map>
+#include "epoch.h"
+
+HashIndex::HashIndex(size_t bucket_count)
+	: buckets_count(bucket_count), buckets(std::make_unique<std::atomic<const Entries*>[]>(bucket_count)) {
+	for (size_t i = 0; i < buckets_count; i++) {
+		buckets[i].store(nullptr);
+	}
+}
+
+HashIndex::~HashIndex() {
+	// lookups reach the index through a table map retired to the EpochManager, none is running when it goes away
+	for (size_t i = 0; i < buckets_count; i++) {
+		delete buckets[i].load();
+	}
+}
+
+size_t HashIndex::bucket_count() const {
+	return buckets_count;
+}
+
+size_t HashIndex::bucket_of(const std::string& key) const {
+	return std::hash<std::string>{}(key) % buckets_count;
+}
+
+std::vector<int> HashIndex::find(const std::string& key) const {
+	return bucket(bucket_of(key));
+}
+
+std::vector<int> HashIndex::bucket(size_t bucket_num) const {
+	EpochGuard guard;
+	const Entries* entries = buckets[bucket_num].load();
+	return entries ? *entries : Entries();
+}
+
+void HashIndex::add(size_t bucket_num, int record_id) {
+	std::lock_guard<std::mutex> lock(latch(bucket_num));
+	const Entries* entries = buckets[bucket_num].load();
+
+	if (entries && std::find(entries->begin(), entries->end(), record_id) != entries->end()) {
+		return;
+	}
+
+	auto changed = entries ? new Entries(*entries) : new Entries();
+	changed->push_back(record_id);
+	publish(bucket_num, changed);
+}
+
+void HashIndex::add_many(const std::vector<std::pair<size_t, int>>& entries) {
+	std::map<size_t, std::vector<int>> by_bucket;
+	for (auto& [bucket_num, record_id] : entries) {
+		by_bucket[bucket_num].push_back(record_id);
+	}
+
+	for (auto& [bucket_num, record_ids] : by_bucket) {
+		std::lock_guard<std::mutex> lock(latch(bucket_num));
+		const Entries* old_entries = buckets[bucket_num].load();
+
+		auto changed = old_entries ? new Entries(*old_entries) : new Entries();
+		changed->insert(changed->end(), record_ids.begin(), record_ids.end());
+		publish(bucket_num, changed);
+	}
+}
+
+void HashIndex::remove(size_t bucket_num, int record_id) {
+	std::lock_guard<std::mutex> lock(latch(bucket_num));
+	const Entries* entries = buckets[bucket_num].load();
+
+	if (!entries || std::find(entries->begin(), entries->end(), record_id) == entries->end()) {
+		return;
+	}
+
+	auto changed = new Entries(*entries);
+	changed->erase(std::remove(changed->begin(), changed->end(), record_id), changed->end());
+	publish(bucket_num, changed);
+}
+
+void HashIndex::remove_many(const std::unordered_set<int>& record_ids) {
+	for (size_t bucket_num = 0; bucket_num < buckets_count; bucket_num++) {
+		std::lock_guard<std::mutex> lock(latch(bucket_num));
+		const Entries* entries = buckets[bucket_num].load();
+
+		auto removed = [&](int id) { return record_ids.count(id) > 0; };
+		if (!entries || std::none_of(entries->begin(), entries->end(), removed)) {
+			continue;
+		}
+
+		auto changed = new Entries();
+		std::copy_if(entries->begin(), entries->end(), std::back_inserter(*changed), [&](int id) { return !removed(id); });
+		publish(bucket_num, changed);
+	}
+}
+
+void HashIndex::move(size_t from_bucket, size_t to_bucket, int old_id, int new_id) {
+	if (new_id >= 0) {
+		add(to_bucket, new_id);
+	}
+	if (from_bucket != to_bucket || old_id != new_id) {
+		remove(from_bucket, old_id);
+	}
+}
+
+void HashIndex::assign(const std::vector<std::vector<int>>& new_buckets) {
+	for (size_t bucket_num = 0; bucket_num < buckets_count; bucket_num++) {
+		std::lock_guard<std::mutex> lock(latch(bucket_num));
+		auto& entries = new_buckets[bucket_num];
+		publish(bucket_num, entries.empty() ? nullptr : new Entries(entries));
+	}
+}
+
+size_t HashIndex::memory_bytes() const {
+	size_t bytes = buckets_count * sizeof(buckets[0]);
+	EpochGuard guard;
+
+	for (size_t bucket_num = 0; bucket_num < buckets_count; bucket_num++) {
+		const Entries* entries = buckets[bucket_num].load();
+		if (entries) {
+			bytes += sizeof(Entries) + entries->capacity() * sizeof(int);
+		}
+	}
+	return bytes;
+}
+
+void HashIndex::publish(size_t bucket_num, const Entries* entries) {
+	const Entries* old_entries = buckets[bucket_num].exchange(entries);
+	if (old_entries) {
+		EpochManager::instance().retire(old_entries);
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+static const int INDEX_LATCH_STRIPES = 64; // writer latches per index, bucket n uses latch n % INDEX_LATCH_STRIPES
+
+/**
+ * Hash index from a key to record IDs with a fixed number of buckets. Lookups take no lock: every bucket is an
+ * immutable vector behind an atomic pointer, read under an EpochGuard. Writers latch the bucket, publish a changed
+ * copy and retire the old vector to the EpochManager, which frees it when no lookup can still be reading it.
+ */
+class HashIndex {
+public:
+	explicit HashIndex(size_t bucket_count);
+	~HashIndex();
+
+	HashIndex(const HashIndex&) = delete;
+	HashIndex& operator=(const HashIndex&) = delete;
+
+	size_t bucket_count() const;
+	size_t bucket_of(const std::string& key) const;
+
+	// Record IDs in the bucket of the key, other keys of the bucket included
+	std::vector<int> find(const std::string& key) const;
+	std::vector<int> bucket(size_t bucket_num) const;
+
+	// Add a record ID unless the bucket has it
+	void add(size_t bucket_num, int record_id);
+
+	// Add new record IDs (bucket, record ID), one copy per changed bucket
+	void add_many(const std::vector<std::pair<size_t, int>>& entries);
+
+	void remove(size_t bucket_num, int record_id);
+	void remove_many(const std::unordered_set<int>& record_ids);
+
+	// Move a record ID to another bucket (none if new_id is negative). It is added first, a lookup never misses it.
+	void move(size_t from_bucket, size_t to_bucket, int old_id, int new_id);
+
+	// Replace every bucket, buckets.size() must be bucket_count()
+	void assign(const std::vector<std::vector<int>>& buckets);
+
+	size_t memory_bytes() const;
+
+private:
+	using Entries = std::vector<int>;
+
+	// Swap in the new entries and retire the old ones, the caller holds the bucket latch
+	void publish(size_t bucket_num, const Entries* entries);
+
+	std::mutex& latch(size_t bucket_num) const {
+		return latches[bucket_num % INDEX_LATCH_STRIPES];
+	}
+
+	size_t buckets_count;
+	std::unique_ptr<std::atomic<const Entries*>[]> buckets; // nullptr for an empty bucket
+	mutable std::mutex latches[INDEX_LATCH_STRIPES];
+};
@@ -0,0 +1,174 @@
+#include "latency_histogram.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+static const uint64_t SUB_BUCKETS = 1ull << LATENCY_SUB_BUCKET_BITS;
+
+uint64_t HistogramSnapshot::percentile(double p) const {
+	if (count == 0) {
+		return 0;
+	}
+
+	uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(p * count));
+	uint64_t seen = 0;
+
+	for (size_t bucket = 0; bucket < counts.size(); bucket++) {
+		seen += counts[bucket];
+		if (seen >= rank) {
+			return std::min(LatencyHistogram::bucket_upper_bound(bucket), max);
+		}
+	}
+	return max;
+}
+
+double HistogramSnapshot::mean() const {
+	return count == 0 ? 0 : (double)sum / count;
+}
+
+LatencyHistogram::LatencyHistogram() : counts(new std::atomic<uint64_t>[bucket_count()]) {
+	reset();
+}
+
+size_t LatencyHistogram::bucket_count() {
+	return SUB_BUCKETS + (LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+}
+
+size_t LatencyHistogram::bucket_of(uint64_t value) {
+	if (value < SUB_BUCKETS) {
+		return value;
+	}
+
+	int exponent = std::bit_width(value) - 1;
+	if (exponent > LATENCY_MAX_EXPONENT) {
+		return bucket_count() - 1;
+	}
+
+	int shift = exponent - LATENCY_SUB_BUCKET_BITS;
+	uint64_t sub_bucket = (value >> shift) - SUB_BUCKETS;
+	return SUB_BUCKETS + shift * SUB_BUCKETS + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(size_t bucket) {
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+
+	uint64_t shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+	uint64_t sub_bucket = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+	return ((SUB_BUCKETS + sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+	counts[bucket_of(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+	uint64_t current = max.load(std::memory_order_relaxed);
+	while (nanoseconds > current && !max.compare_exchange_weak(current, nanoseconds, std::memory_order_relaxed)) {
+	}
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const {
+	HistogramSnapshot snapshot;
+	snapshot.counts.resize(bucket_count());
+
+	// the total is the sum of the copied buckets, so percentiles stay consistent while others record
+	for (size_t bucket = 0; bucket < snapshot.counts.size(); bucket++) {
+		snapshot.counts[bucket] = counts[bucket].load(std::memory_order_relaxed);
+		snapshot.count += snapshot.counts[bucket];
+	}
+	snapshot.sum = sum.load(std::memory_order_relaxed);
+	snapshot.max = max.load(std::memory_order_relaxed);
+	return snapshot;
+}
+
+void LatencyHistogram::reset() {
+	for (size_t bucket = 0; bucket < bucket_count(); bucket++) {
+		counts[bucket].store(0, std::memory_order_relaxed);
+	}
+	sum.store(0, std::memory_order_relaxed);
+	max.store(0, std::memory_order_relaxed);
+}
+
+const char* latency_op_name(LatencyOp op) {
+	switch (op) {
+	case LatencyOp::Insert: return "insert";
+	case LatencyOp::InsertMany: return "insert_many";
+	case LatencyOp::Get: return "get";
+	case LatencyOp::Update: return "update";
+	case LatencyOp::UpdateWhere: return "update_where";
+	case LatencyOp::Delete: return "delete";
+	case LatencyOp::DeleteMany: return "delete_many";
+	case LatencyOp::Scan: return "scan";
+	case LatencyOp::ParallelScan: return "parallel_scan";
+	case LatencyOp::Find: return "find";
+	case LatencyOp::Vacuum: return "vacuum";
+	case LatencyOp::WriteBack: return "write_back";
+	case LatencyOp::SqlInsert: return "sql_insert";
+	case LatencyOp::SqlSelect: return "sql_select";
+	case LatencyOp::SqlUpdate: return "sql_update";
+	case LatencyOp::SqlDelete: return "sql_delete";
+	case LatencyOp::Count: break;
+	}
+	return "unknown";
+}
+
+HistogramSnapshot LatencyHistograms::snapshot(LatencyOp op) const {
+	return histograms[static_cast<size_t>(op)].snapshot();
+}
+
+void LatencyHistograms::reset() {
+	for (auto& histogram : histograms) {
+		histogram.reset();
+	}
+}
+
+std::vector<std::string> LatencyHistograms::format() const {
+	std::vector<std::string> lines;
+	std::ostringstream header;
+	header << std::left << std::setw(16) << "operation" << std::right << std::setw(10) << "count"
+		<< std::setw(12) << "mean_us" << std::setw(12) << "p50_us" << std::setw(12) << "p99_us"
+		<< std::setw(12) << "p999_us" << std::setw(12) << "max_us";
+	lines.push_back(header.str());
+
+	for (size_t i = 0; i < LATENCY_OP_COUNT; i++) {
+		HistogramSnapshot snapshot = histograms[i].snapshot();
+		if (snapshot.count == 0) {
+			continue;
+		}
+
+		std::ostringstream line;
+		line << std::fixed << std::setprecision(1)
+			<< std::left << std::setw(16) << latency_op_name(static_cast<LatencyOp>(i)) << std::right << std::setw(10) << snapshot.count
+			<< std::setw(12) << snapshot.mean() / 1000.0
+			<< std::setw(12) << snapshot.percentile(0.5) / 1000.0
+			<< std::setw(12) << snapshot.percentile(0.99) / 1000.0
+			<< std::setw(12) << snapshot.percentile(0.999) / 1000.0
+			<< std::setw(12) << snapshot.max / 1000.0;
+		lines.push_back(line.str());
+	}
+	return lines;
+}
+
+void LatencyHistograms::write_json(std::ostream& out) const {
+	out << std::fixed << std::setprecision(3) << "{\n";
+	bool first = true;
+
+	for (size_t i = 0; i < LATENCY_OP_COUNT; i++) {
+		HistogramSnapshot snapshot = histograms[i].snapshot();
+		if (snapshot.count == 0) {
+			continue;
+		}
+
+		out << (first ? "" : ",\n") << "  \"" << latency_op_name(static_cast<LatencyOp>(i)) << "\": {\"count\": " << snapshot.count
+			<< ", \"mean_us\": " << snapshot.mean() / 1000.0
+			<< ", \"p50_us\": " << snapshot.percentile(0.5) / 1000.0
+			<< ", \"p99_us\": " << snapshot.percentile(0.99) / 1000.0
+			<< ", \"p999_us\": " << snapshot.percentile(0.999) / 1000.0
+			<< ", \"max_us\": " << snapshot.max / 1000.0 << "}";
+		first = false;
+	}
+	out << "\n}\n";
+}
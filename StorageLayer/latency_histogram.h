@@ -0,0 +1,112 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+static const int LATENCY_SUB_BUCKET_BITS = 5; // 32 linear buckets per power of two, at most 3% relative error
+static const int LATENCY_MAX_EXPONENT = 40; // values up to 2^41 ns (about 36 minutes), larger ones land in the last bucket
+
+// Point in time copy of a histogram, latencies in nanoseconds
+struct HistogramSnapshot {
+	std::vector<uint64_t> counts;
+	uint64_t count = 0;
+	uint64_t sum = 0;
+	uint64_t max = 0;
+
+	// Upper bound of the bucket holding the p-th latency, p in [0, 1]
+	uint64_t percentile(double p) const;
+	double mean() const;
+};
+
+/**
+ * Log-linear latency histogram in the style of HdrHistogram: values below 32 get their own bucket,
+ * every larger power of two is split into 32 buckets. Recording is a few relaxed atomic increments,
+ * so it can stay on all the time and be recorded from several threads.
+ */
+class LatencyHistogram {
+public:
+	LatencyHistogram();
+
+	void record(uint64_t nanoseconds);
+	HistogramSnapshot snapshot() const;
+	void reset();
+
+	static size_t bucket_of(uint64_t value);
+	static uint64_t bucket_upper_bound(size_t bucket);
+	static size_t bucket_count();
+
+private:
+	std::unique_ptr<std::atomic<uint64_t>[]> counts;
+	std::atomic<uint64_t> sum{ 0 };
+	std::atomic<uint64_t> max{ 0 };
+};
+
+// Operations with their own histogram; storage calls made by other storage calls are recorded too
+enum class LatencyOp {
+	Insert,
+	InsertMany,
+	Get,
+	Update,
+	UpdateWhere,
+	Delete,
+	DeleteMany,
+	Scan,
+	ParallelScan,
+	Find,
+	Vacuum,
+	WriteBack,
+	SqlInsert,
+	SqlSelect,
+	SqlUpdate,
+	SqlDelete,
+
+	Count
+};
+
+static const size_t LATENCY_OP_COUNT = static_cast<size_t>(LatencyOp::Count);
+
+const char* latency_op_name(LatencyOp op);
+
+// One histogram per operation
+class LatencyHistograms {
+public:
+	void record(LatencyOp op, uint64_t nanoseconds) {
+		histograms[static_cast<size_t>(op)].record(nanoseconds);
+	}
+
+	HistogramSnapshot snapshot(LatencyOp op) const;
+	void reset();
+
+	// Lines of a table with count, mean, p50, p99, p99.9 and max in microseconds, operations without calls are left out
+	std::vector<std::string> format() const;
+	void write_json(std::ostream& out) const;
+
+private:
+	std::array<LatencyHistogram, LATENCY_OP_COUNT> histograms;
+};
+
+// Records the time from construction to destruction
+class LatencyTimer {
+public:
+	LatencyTimer(LatencyHistograms& histograms, LatencyOp op)
+		: histograms(histograms), op(op), start(std::chrono::steady_clock::now()) {
+	}
+
+	~LatencyTimer() {
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+		histograms.record(op, static_cast<uint64_t>(elapsed.count()));
+	}
+
+	LatencyTimer(const LatencyTimer&) = delete;
+	LatencyTimer& operator=(const LatencyTimer&) = delete;
+
+private:
+	LatencyHistograms& histograms;
+	LatencyOp op;
+	std::chrono::steady_clock::time_point start;
+};
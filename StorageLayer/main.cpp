@@ -2,13 +2,18 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <cstring>
 #include <unordered_map>
 #include <algorithm>
+#include <iomanip>
+#include <chrono>
 #include "file_storage_layer.h"
 #include "table_schema.h"
 #include "parser.h"
 #include "ast.h"
 #include "query_executor.h"
+#include "plan_cache.h"
+#include "trace.h"
 
 void print_help() {
     std::cout << "Storage Layer CLI - Available commands:\n"
@@ -23,6 +28,13 @@ void print_help() {
         << "  delete <table name> <record_id>          - Delete a record\n"
         << "  scan <table name> [--projection <field1> <field2> ...] - Scan records in a table\n"
         << "  find <table name> <key>                  - find records by index\n"
+        << "  stats [reset]                            - Show I/O and operation counters, or reset them\n"
+        << "  latency [reset]                          - Show latency percentiles per operation, or reset them\n"
+        << "  trace start <file> | trace stop          - Record spans of the following commands as Chrome trace JSON\n"
+        << "  memory [limit <bytes>]                   - Show memory per table and of queries, or set the query memory limit (0 = none)\n"
+        << "  slowlog <file> <ms> | slowlog off        - Log statements and storage calls slower than <ms> to <file>\n"
+        << "  vacuum [on | off | budget <pages/s>]     - Show dead space per table, or switch or throttle the vacuum worker (0 = no limit)\n"
+        << "  durability [sync | async]                - Show dirty pages per table, or set when writes reach the disk\n"
         << "  help                                     - Display this help message\n"
         << "  --query <SQL query>                      - Execute SQL using parser\n"
         << "  exit/quit                                - Exit the program\n";
@@ -132,6 +144,7 @@ template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
 
 int main() {
     FileStorageLayer storage;
+    PlanCache plan_cache;
 
     std::cout << "Storage Layer CLI - Type 'help' for available commands or 'exit' to quit\n";
 
@@ -148,6 +161,7 @@ int main() {
         std::string command = args[0];
 
         if (command == "exit" || command == "quit") {
+            Tracer::instance().stop(); // keep a trace that was not stopped
             break;
         }
         else if (command == "help") {
@@ -496,6 +510,145 @@ int main() {
                 std::cout << "Found ID = " << id << std::endl;
             }
         }
+        else if (command == "stats") {
+            if (args.size() > 1 && args[1] == "reset") {
+                storage.reset_counters();
+                std::cout << "Counters reset\n";
+                continue;
+            }
+
+            StorageStats stats = storage.counters_snapshot();
+            for (auto& [name, value] : stats.entries()) {
+                std::cout << "  " << std::left << std::setw(22) << name << value << std::endl;
+            }
+            std::cout << "  " << std::left << std::setw(22) << "syscalls" << stats.syscalls() << std::endl;
+        }
+        else if (command == "latency") {
+            if (args.size() > 1 && args[1] == "reset") {
+                storage.latencies().reset();
+                std::cout << "Latency histograms reset\n";
+                continue;
+            }
+
+            for (auto& line : storage.latencies().format()) {
+                std::cout << line << std::endl;
+            }
+        }
+        else if (command == "memory") {
+            if (args.size() > 2 && args[1] == "limit") {
+                try {
+                    storage.memory().set_limit(std::stoull(args[2]));
+                    std::cout << "Query memory limit set to " << args[2] << " bytes\n";
+                }
+                catch (const std::exception&) {
+                    std::cout << "Error: invalid byte count " << args[2] << std::endl;
+                }
+                continue;
+            }
+
+            MemoryUsage usage = storage.memory_usage();
+            std::cout << "  " << std::left << std::setw(20) << "table" << std::right << std::setw(12) << "index"
+                << std::setw(12) << "schema" << std::setw(12) << "stats" << std::setw(12) << "undo" << std::setw(12) << "dirty" << std::setw(12) << "total" << std::endl;
+            for (auto& table : usage.tables) {
+                std::cout << "  " << std::left << std::setw(20) << table.table << std::right << std::setw(12) << table.index_bytes
+                    << std::setw(12) << table.schema_bytes << std::setw(12) << table.stats_bytes << std::setw(12) << table.undo_bytes
+                    << std::setw(12) << table.dirty_bytes << std::setw(12) << table.total() << std::endl;
+            }
+            std::cout << "  query results: " << usage.query_bytes << " bytes (peak " << usage.query_peak_bytes << ", limit "
+                << (usage.limit_bytes ? std::to_string(usage.limit_bytes) : std::string("none")) << ")\n";
+            std::cout << "  plan cache: " << plan_cache.memory_bytes() << " bytes in " << plan_cache.size() << " statements\n";
+            std::cout << "  total: " << usage.total() + plan_cache.memory_bytes() << " bytes\n";
+        }
+        else if (command == "vacuum") {
+            VacuumSettings settings = storage.vacuum_settings();
+            if (args.size() > 1 && (args[1] == "on" || args[1] == "off")) {
+                settings.enabled = args[1] == "on";
+                storage.set_vacuum_settings(settings);
+                std::cout << "Vacuum worker " << (settings.enabled ? "enabled" : "disabled") << std::endl;
+                continue;
+            }
+            if (args.size() > 2 && args[1] == "budget") {
+                try {
+                    settings.pages_per_second = std::stoull(args[2]);
+                    storage.set_vacuum_settings(settings);
+                    std::cout << "Vacuum budget set to " << args[2] << " pages/s\n";
+                }
+                catch (const std::exception&) {
+                    std::cout << "Error: invalid page count " << args[2] << std::endl;
+                }
+                continue;
+            }
+
+            std::cout << "  worker " << (settings.enabled ? "enabled" : "disabled") << ", budget "
+                << (settings.pages_per_second ? std::to_string(settings.pages_per_second) + " pages/s" : std::string("none"))
+                << ", threshold " << settings.min_dead_bytes << " bytes and " << settings.dead_fraction * 100 << "% of the table\n";
+            for (auto& table : storage.list_tables()) {
+                std::cout << "  " << std::left << std::setw(20) << table << std::right << std::setw(12) << storage.dead_bytes(table)
+                    << " dead bytes" << std::endl;
+            }
+        }
+        else if (command == "durability") {
+            WriteBackSettings settings = storage.write_back_settings();
+            if (args.size() > 1 && (args[1] == "sync" || args[1] == "async")) {
+                settings.durability = args[1] == "sync" ? Durability::Sync : Durability::Async;
+                storage.set_write_back_settings(settings);
+                std::cout << "Writes are " << (args[1] == "sync" ? "on disk when they return\n" : "written back in the background\n");
+                continue;
+            }
+            if (args.size() > 1) {
+                std::cout << "Error: Usage: durability [sync | async]\n";
+                continue;
+            }
+
+            std::cout << "  " << (settings.durability == Durability::Sync ? "sync" : "async") << ", write-back every "
+                << settings.interval.count() << " ms or at " << settings.max_dirty_pages << " dirty pages per table\n";
+            for (auto& table : storage.list_tables()) {
+                std::cout << "  " << std::left << std::setw(20) << table << std::right << std::setw(12) << storage.dirty_pages(table)
+                    << " dirty pages" << std::endl;
+            }
+        }
+        else if (command == "slowlog") {
+            if (args.size() > 1 && args[1] == "off") {
+                storage.slow_log().close();
+                std::cout << "Slow query log closed\n";
+            }
+            else if (args.size() > 2) {
+                try {
+                    double threshold_ms = std::stod(args[2]);
+                    if (!storage.slow_log().open(args[1], threshold_ms)) {
+                        std::cout << "Error: can not open " << args[1] << std::endl;
+                        continue;
+                    }
+                    std::cout << "Logging statements slower than " << threshold_ms << " ms to " << args[1] << std::endl;
+                }
+                catch (const std::exception&) {
+                    std::cout << "Error: invalid threshold " << args[2] << std::endl;
+                }
+            }
+            else {
+                std::cout << "Error: Usage: slowlog <file> <threshold ms> | slowlog off\n";
+            }
+        }
+        else if (command == "trace") {
+            if (args.size() > 2 && args[1] == "start") {
+                if (!Tracer::instance().start(args[2])) {
+                    std::cout << "Error: a trace is already running\n";
+                    continue;
+                }
+                std::cout << "Tracing to " << args[2] << std::endl;
+            }
+            else if (args.size() > 1 && args[1] == "stop") {
+                std::string path = Tracer::instance().path();
+                if (!Tracer::instance().stop()) {
+                    std::cout << "Error: no trace is running or the file can not be written\n";
+                    continue;
+                }
+                std::cout << "Trace written to " << path << std::endl;
+            }
+            else {
+                std::cout << "Error: Usage: trace start <file> | trace stop\n";
+            }
+        }
         else if (command == "--query") {
             if (args.size() < 2) {
                 std::cout << "Error: missing SQL query" << std::endl;
@@ -541,7 +694,10 @@ int main() {
             }
 
             try {
-                AST stmt = parse_sql_to_ast(sql);
+                auto query_start = std::chrono::steady_clock::now();
+                StorageStats io_before = storage.counters_snapshot();
+
+                AST stmt = plan_cache.parse(sql);
                 QueryExecutor q_ex(storage);
 
                 std::visit(overloaded{
@@ -576,8 +732,19 @@ int main() {
                         }
                     },
                     [&](const InsertStatement& insert) {
-                        int id = q_ex.executeInsert(insert);
-                        std::cout << "Inserted ID = " << id << std::endl;
+                        auto ids = q_ex.executeInsert(insert);
+                        size_t failed = std::count_if(ids.begin(), ids.end(), [](int id) { return id < 0; });
+
+                        if (ids.size() == 1 && failed == 0) {
+                            std::cout << "Inserted ID = " << ids[0] << std::endl;
+                        }
+                        else {
+                            std::cout << "Inserted " << ids.size() - failed << " rows";
+                            if (failed > 0) {
+                                std::cout << ", " << failed << " failed";
+                            }
+                            std::cout << std::endl;
+                        }
                     },
                     [&](const SelectStatement& select) {
                         auto rows = q_ex.executeSelect(select);
@@ -587,6 +754,13 @@ int main() {
                             for (auto& col : schema.columns) {
                                 std::cout << col.name << "\t";
                             }
+
+                            if (select.join) {
+                                auto join_schema = storage.get_table_schema(select.join->table_name);
+                                for (auto& col : join_schema.columns) {
+                                    std::cout << col.name << "\t";
+                                }
+                            }
                         }
                         else {
                             for (auto& col : select.columns) {
@@ -608,11 +782,58 @@ int main() {
                         auto count = q_ex.executeDelete(stmt);
                         std::cout << "Deleted " << count << " rows" << std::endl;
                     },
+                    [&](const UpdateStatement& stmt) {
+                        auto count = q_ex.executeUpdate(stmt);
+                        std::cout << "Updated " << count << " rows" << std::endl;
+                    },
                     [&](const CTASStatement& stmt) {
                         int count = q_ex.executeCreateTableAs(stmt);
                         std::cout << "CTAS created " << stmt.table_name << " with " << count << " rows" << std::endl;
+                    },
+                    [&](const PrepareStatement& stmt) {
+                        std::cout << "Statement " << stmt.name << " prepared" << std::endl;
+                    },
+                    [&](const ExecuteStatement&) {
+                        // never reached, the plan cache replaces EXECUTE with the bound prepared statement or throws
+                    },
+                    [&](const AnalyzeStatement& stmt) {
+                        for (auto& table : q_ex.executeAnalyze(stmt)) {
+                            auto stats = storage.get_table_stats(table);
+                            auto schema = storage.get_table_schema(table);
+
+                            std::cout << "Analyzed " << table << ": " << stats->row_count << " rows, " << stats->page_count
+                                << " pages (" << stats->sampled_pages << " sampled)" << std::endl;
+
+                            for (size_t i = 0; i < stats->columns.size() && i < schema.columns.size(); i++) {
+                                auto& column = stats->columns[i];
+                                std::cout << "  " << schema.columns[i].name
+                                    << " min=" << (column.min ? value_to_string(*column.min) : "NULL")
+                                    << " max=" << (column.max ? value_to_string(*column.max) : "NULL")
+                                    << " distinct~" << (long long)column.distinct_values() << std::endl;
+                            }
+                        }
+                    },
+                    [&](const ExplainStatement& stmt) {
+                        for (auto& line : q_ex.executeExplain(stmt)) {
+                            std::cout << line << std::endl;
+                        }
                     }
                 }, stmt);
+
+                double duration_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - query_start).count();
+                if (storage.slow_log().is_slow(duration_ms)) {
+                    const StatementStats& stats = q_ex.statementStats();
+
+                    SlowQueryEntry entry;
+                    entry.kind = "sql";
+                    entry.statement = sql;
+                    entry.duration_ms = duration_ms;
+                    entry.access_paths = stats.access_paths;
+                    entry.rows_scanned = stats.rows_scanned;
+                    entry.rows_returned = stats.rows_returned;
+                    entry.io = storage.counters_snapshot().since(io_before);
+                    storage.slow_log().write(entry);
+                }
             }
             catch (const std::exception& e) {
                 std::cout << "SQL parse error: " << e.what() << std::endl;
@@ -0,0 +1,103 @@
+#include "memory_tracker.h"
+#include <cstdint>
+
+void MemoryTracker::set_limit(size_t bytes) {
+	limit_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+size_t MemoryTracker::limit() const {
+	return limit_bytes.load(std::memory_order_relaxed);
+}
+
+size_t MemoryTracker::used() const {
+	return used_bytes.load(std::memory_order_relaxed);
+}
+
+size_t MemoryTracker::peak() const {
+	return peak_bytes.load(std::memory_order_relaxed);
+}
+
+size_t MemoryTracker::available() const {
+	size_t limit = this->limit();
+	if (limit == 0) {
+		return SIZE_MAX;
+	}
+	size_t used = this->used();
+	return used >= limit ? 0 : limit - used;
+}
+
+bool MemoryTracker::try_reserve(size_t bytes) {
+	size_t limit = this->limit();
+	size_t current = used_bytes.load(std::memory_order_relaxed);
+	size_t next;
+
+	do {
+		next = current + bytes;
+		if (limit != 0 && next > limit) {
+			return false;
+		}
+	} while (!used_bytes.compare_exchange_weak(current, next, std::memory_order_relaxed));
+
+	size_t peak = peak_bytes.load(std::memory_order_relaxed);
+	while (next > peak && !peak_bytes.compare_exchange_weak(peak, next, std::memory_order_relaxed)) {
+	}
+	return true;
+}
+
+void MemoryTracker::release(size_t bytes) {
+	used_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void MemoryTracker::reset_peak() {
+	peak_bytes.store(used(), std::memory_order_relaxed);
+}
+
+MemoryReservation::MemoryReservation(MemoryTracker& tracker, std::string owner)
+	: tracker(tracker), owner(std::move(owner)) {
+}
+
+MemoryReservation::~MemoryReservation() {
+	tracker.release(reserved.load(std::memory_order_relaxed));
+}
+
+void MemoryReservation::grow(size_t bytes) {
+	if (!try_grow(bytes)) {
+		throw MemoryLimitExceeded("Memory limit of " + std::to_string(tracker.limit()) + " bytes exceeded by " + owner
+			+ " (" + std::to_string(tracker.used()) + " bytes in use, " + std::to_string(bytes) + " more requested)");
+	}
+}
+
+bool MemoryReservation::try_grow(size_t bytes) {
+	if (!tracker.try_reserve(bytes)) {
+		return false;
+	}
+	reserved.fetch_add(bytes, std::memory_order_relaxed);
+	return true;
+}
+
+size_t MemoryReservation::bytes() const {
+	return reserved.load(std::memory_order_relaxed);
+}
+
+size_t record_bytes(const std::vector<uint8_t>& record) {
+	return sizeof(record) + record.capacity();
+}
+
+size_t row_bytes(const std::vector<std::string>& row) {
+	size_t bytes = sizeof(row) + row.capacity() * sizeof(std::string);
+	for (auto& value : row) {
+		// short strings live inside the std::string object
+		if (value.capacity() > std::string().capacity()) {
+			bytes += value.capacity() + 1;
+		}
+	}
+	return bytes;
+}
+
+size_t MemoryUsage::total() const {
+	size_t bytes = query_bytes;
+	for (auto& table : tables) {
+		bytes += table.total();
+	}
+	return bytes;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Thrown when a query would grow its intermediate results past the memory limit
+class MemoryLimitExceeded : public std::runtime_error {
+public:
+	explicit MemoryLimitExceeded(const std::string& message) : std::runtime_error(message) {
+	}
+};
+
+/**
+ * Bytes held by query intermediate results (collected records, result rows, aggregation groups,
+ * join hash tables), checked against an optional limit. Reservations may come from the scan workers.
+ */
+class MemoryTracker {
+public:
+	// 0 turns the limit off
+	void set_limit(size_t bytes);
+	size_t limit() const;
+
+	size_t used() const;
+	size_t peak() const;
+
+	// Bytes that can still be reserved, SIZE_MAX without a limit
+	size_t available() const;
+
+	bool try_reserve(size_t bytes);
+	void release(size_t bytes);
+
+	void reset_peak();
+
+private:
+	std::atomic<size_t> limit_bytes{ 0 };
+	std::atomic<size_t> used_bytes{ 0 };
+	std::atomic<size_t> peak_bytes{ 0 };
+};
+
+// Bytes reserved for one query operator, released together when it goes out of scope
+class MemoryReservation {
+public:
+	MemoryReservation(MemoryTracker& tracker, std::string owner);
+	~MemoryReservation();
+
+	MemoryReservation(const MemoryReservation&) = delete;
+	MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+	// Throws MemoryLimitExceeded naming the owner when the tracker has no room left
+	void grow(size_t bytes);
+	bool try_grow(size_t bytes);
+
+	size_t bytes() const;
+
+private:
+	MemoryTracker& tracker;
+	std::string owner;
+	std::atomic<size_t> reserved{ 0 };
+};
+
+// Estimated heap bytes of the values kept per record or row
+size_t record_bytes(const std::vector<uint8_t>& record);
+size_t row_bytes(const std::vector<std::string>& row);
+
+// Memory of the in-memory structures of one table
+struct TableMemory {
+	std::string table;
+	size_t index_bytes = 0;
+	size_t schema_bytes = 0;
+	size_t stats_bytes = 0;
+	size_t undo_bytes = 0; // record versions kept for running scans
+	size_t dirty_bytes = 0; // pages not written back yet
+
+	size_t total() const {
+		return index_bytes + schema_bytes + stats_bytes + undo_bytes + dirty_bytes;
+	}
+};
+
+struct MemoryUsage {
+	std::vector<TableMemory> tables;
+	size_t query_bytes = 0; // intermediate results of running queries
+	size_t query_peak_bytes = 0;
+	size_t limit_bytes = 0;
+
+	size_t total() const;
+};
@@ -1,69 +1,126 @@
 #include <string>
+#include <memory>
+#include <stdexcept>
 #include "ast.h"
+#include "trace.h"
 #include <pg_query.h>
-#include "json.hpp"
-#include <iostream>
+#include <protobuf/pg_query.pb-c.h>
+
+// Text of the statement after the AS keyword of a PREPARE. AS is a reserved keyword, so a quoted name or a
+// string literal containing "as" is scanned as another token and never matches.
+static std::string prepared_query_text(const std::string& sql, const PgQuery__RawStmt& raw) {
+	PgQueryScanResult scan = pg_query_scan(sql.c_str());
+
+	if (scan.error) {
+		std::string message = scan.error->message;
+		pg_query_free_scan_result(scan);
+
+		throw std::runtime_error("Parse error: " + message);
+	}
+
+	std::unique_ptr<PgQuery__ScanResult, void(*)(PgQuery__ScanResult*)> tokens(
+		pg_query__scan_result__unpack(nullptr, scan.pbuf.len, reinterpret_cast<const uint8_t*>(scan.pbuf.data)),
+		[](PgQuery__ScanResult* result) { pg_query__scan_result__free_unpacked(result, nullptr); });
+
+	pg_query_free_scan_result(scan);
+
+	if (!tokens) {
+		throw std::runtime_error("Invalid scan result");
+	}
+
+	// a statement length of 0 means the statement runs to the end of the string
+	size_t begin = raw.stmt_location;
+	size_t end = raw.stmt_len > 0 ? begin + raw.stmt_len : sql.size();
+
+	for (size_t i = 0; i < tokens->n_tokens; ++i) {
+		const PgQuery__ScanToken* token = tokens->tokens[i];
+		if (token->token == PG_QUERY__TOKEN__AS && static_cast<size_t>(token->start) >= begin && static_cast<size_t>(token->end) <= end) {
+			return sql.substr(token->end, end - token->end);
+		}
+	}
+
+	throw std::runtime_error("PREPARE requires AS <statement>");
+}
 
 AST parse_sql_to_ast(const std::string& sql) {
-	PgQueryParseResult res = pg_query_parse(sql.c_str());
+	TraceSpan span("parse", "sql");
+	span.arg("sql", sql);
+
+	PgQueryProtobufParseResult res = pg_query_parse_protobuf(sql.c_str());
 
 	if (res.error) {
 		std::string message = res.error->message;
-		pg_query_free_parse_result(res);
+		pg_query_free_protobuf_parse_result(res);
 
 		throw std::runtime_error("Parse error: " + message);
 	}
 
-	std::string json_string = res.parse_tree;
-	pg_query_free_parse_result(res);
+	// the walkers copy everything they need into the AST, so the unpacked tree is freed on return
+	std::unique_ptr<PgQuery__ParseResult, void(*)(PgQuery__ParseResult*)> tree(
+		pg_query__parse_result__unpack(nullptr, res.parse_tree.len, reinterpret_cast<const uint8_t*>(res.parse_tree.data)),
+		[](PgQuery__ParseResult* result) { pg_query__parse_result__free_unpacked(result, nullptr); });
 
-	auto root = nlohmann::json::parse(json_string);
+	pg_query_free_protobuf_parse_result(res);
 
-	if (!root.contains("stmts") || !root["stmts"].is_array() || root.at("stmts").empty()) {
-		throw std::runtime_error("Invalid JSON structure: 'stmts' is missing/empty/not an array");
+	if (!tree) {
+		throw std::runtime_error("Invalid parse tree");
 	}
 
-	nlohmann::json stmt_json = root.at("stmts").at(0).at("stmt");
+	if (tree->n_stmts == 0 || tree->stmts[0]->stmt == nullptr) {
+		throw std::runtime_error("Query is empty");
+	}
 
-	// debuging output
+	const PgQuery__Node* node = tree->stmts[0]->stmt;
 
-	std::cout << "Parsed JSON: " << stmt_json.dump(4) << std::endl;
+	switch (node->node_case) {
+	case PG_QUERY__NODE__NODE_CREATE_STMT:
+		return parse_create_table_stmt(*node->create_stmt);
+
+	case PG_QUERY__NODE__NODE_CREATE_TABLE_AS_STMT: {
+		const PgQuery__CreateTableAsStmt* ctas = node->create_table_as_stmt;
+
+		if (ctas->query == nullptr || ctas->query->node_case != PG_QUERY__NODE__NODE_SELECT_STMT) {
+			throw std::runtime_error("CREATE TABLE AS requires a SELECT");
+		}
 
-	if (stmt_json.contains("CreateStmt")) {
-		const auto& cs = stmt_json.at("CreateStmt");
-		return parse_create_table_json(cs);
-	}
-	else if (stmt_json.contains("CreateTableAsStmt")) {
-		const auto& ctas = stmt_json.at("CreateTableAsStmt");
 		CTASStatement stmt;
-		stmt.table_name = ctas.at("into").at("rel").at("relname").get<std::string>();
-		stmt.selectStmt = parse_select_json(ctas.at("query").at("SelectStmt"));
+		stmt.table_name = ctas->into->rel->relname;
+		stmt.selectStmt = parse_select_stmt(*ctas->query->select_stmt);
 		return stmt;
 	}
-	else if (stmt_json.contains("InsertStmt")) {
-		return parse_insert_json(stmt_json["InsertStmt"]);
-	}
-	else if (stmt_json.contains("DeleteStmt")) {
-		const auto& ds = stmt_json.at("DeleteStmt");
-		DeleteStatement stmt;
-		stmt.table_name = ds.at("relation").at("relname").get<std::string>();
-		if (ds.contains("whereClause")) {
-			auto& aexpr = ds.at("whereClause").at("A_Expr");
-			stmt.where_column = aexpr.at("lexpr").at("ColumnRef").at("fields").at(0).at("String").at("sval").get<std::string>();
-			stmt.where_operator = aexpr.at("name").at(0).at("String").at("sval").get<std::string>();
-			auto& rvalue = aexpr.at("rexpr").at("A_Const");
-			if (rvalue.contains("ival")) {
-				stmt.where_value = std::to_string(rvalue.at("ival").at("ival").get<int>());
-			}
-			else {
-				stmt.where_value = rvalue.at("sval").at("sval").get<std::string>();
-			}
-		}
 
+	case PG_QUERY__NODE__NODE_INSERT_STMT:
+		return parse_insert_stmt(*node->insert_stmt);
+
+	case PG_QUERY__NODE__NODE_DELETE_STMT:
+		return parse_delete_stmt(*node->delete_stmt);
+
+	case PG_QUERY__NODE__NODE_PREPARE_STMT: {
+		PrepareStatement stmt;
+		stmt.name = node->prepare_stmt->name;
+
+		// the prepared query is kept as text, it is parsed by the plan cache
+		stmt.query = prepared_query_text(sql, *tree->stmts[0]);
 		return stmt;
 	}
-	else if (stmt_json.contains("SelectStmt")) {
-		return parse_select_json(stmt_json["SelectStmt"]);
+
+	case PG_QUERY__NODE__NODE_EXECUTE_STMT:
+		return parse_execute_stmt(*node->execute_stmt);
+
+	case PG_QUERY__NODE__NODE_UPDATE_STMT:
+		return parse_update_stmt(*node->update_stmt);
+
+	case PG_QUERY__NODE__NODE_SELECT_STMT:
+		return parse_select_stmt(*node->select_stmt);
+
+	case PG_QUERY__NODE__NODE_VACUUM_STMT:
+		return parse_analyze_stmt(*node->vacuum_stmt);
+
+	case PG_QUERY__NODE__NODE_EXPLAIN_STMT:
+		return parse_explain_stmt(*node->explain_stmt);
+
+	default:
+		break;
 	}
 
 	throw std::runtime_error("Unknown statement");
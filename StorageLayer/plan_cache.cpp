@@ -0,0 +1,251 @@
+#include "plan_cache.h"
+#include "parser.h"
+#include <cctype>
+#include <stdexcept>
+
+static std::string to_upper(std::string word) {
+	for (auto& c : word) {
+		c = (char)std::toupper((unsigned char)c);
+	}
+	return word;
+}
+
+NormalizedQuery normalize_query(const std::string& sql) {
+	NormalizedQuery result;
+
+	size_t start = sql.find_first_not_of(" \t\r\n");
+	if (start == std::string::npos) {
+		return result;
+	}
+
+	size_t keyword_end = start;
+	while (keyword_end < sql.size() && std::isalpha((unsigned char)sql[keyword_end])) {
+		keyword_end++;
+	}
+
+	std::string keyword = to_upper(sql.substr(start, keyword_end - start));
+	if (keyword != "SELECT" && keyword != "INSERT" && keyword != "UPDATE" && keyword != "DELETE" && keyword != "EXECUTE") {
+		return result;
+	}
+
+	// comments could hide literals, such queries are parsed as written
+	if (sql.find("--") != std::string::npos || sql.find("/*") != std::string::npos) {
+		return result;
+	}
+
+	std::string previous_word; // LIMIT and OFFSET values stay in the text
+	size_t i = start;
+
+	while (i < sql.size()) {
+		char c = sql[i];
+
+		if (c == '\'') {
+			std::string literal;
+			i++;
+
+			while (i < sql.size()) {
+				if (sql[i] == '\'') {
+					if (i + 1 < sql.size() && sql[i + 1] == '\'') {
+						literal += '\'';
+						i += 2;
+						continue;
+					}
+					break;
+				}
+				literal += sql[i++];
+			}
+
+			if (i >= sql.size()) {
+				return NormalizedQuery(); // unterminated string, let the parser report it
+			}
+			i++;
+
+			result.literals.push_back(literal);
+			result.text += "$" + std::to_string(result.literals.size());
+			previous_word.clear();
+		}
+		else if (c == '"') {
+			size_t end = sql.find('"', i + 1);
+			if (end == std::string::npos) {
+				return NormalizedQuery();
+			}
+			result.text += sql.substr(i, end - i + 1);
+			i = end + 1;
+			previous_word.clear();
+		}
+		else if (std::isalpha((unsigned char)c) || c == '_') {
+			size_t end = i;
+			while (end < sql.size() && (std::isalnum((unsigned char)sql[end]) || sql[end] == '_')) {
+				end++;
+			}
+			std::string word = sql.substr(i, end - i);
+			result.text += word;
+			previous_word = to_upper(word);
+			i = end;
+		}
+		else if (std::isdigit((unsigned char)c)) {
+			size_t end = i;
+			while (end < sql.size() && (std::isdigit((unsigned char)sql[end]) || sql[end] == '.')) {
+				end++;
+			}
+			std::string number = sql.substr(i, end - i);
+
+			if (number.find('.') != std::string::npos) {
+				return NormalizedQuery(); // decimals are not supported, let the parser report it
+			}
+
+			if (previous_word == "LIMIT" || previous_word == "OFFSET") {
+				result.text += number;
+			}
+			else {
+				// the parser reads integers as int, so "007" becomes "7"
+				if (number.size() < 10) {
+					number = std::to_string(std::stoi(number));
+				}
+				result.literals.push_back(number);
+				result.text += "$" + std::to_string(result.literals.size());
+			}
+
+			previous_word.clear();
+			i = end;
+		}
+		else if (c == '$' || (c == '-' && i + 1 < sql.size() && std::isdigit((unsigned char)sql[i + 1]))) {
+			// own parameters and negative numbers (folded into the constant by the parser) are not cached
+			return NormalizedQuery();
+		}
+		else if (std::isspace((unsigned char)c)) {
+			if (!result.text.empty() && result.text.back() != ' ') {
+				result.text += ' ';
+			}
+			i++;
+		}
+		else {
+			result.text += c;
+			previous_word.clear();
+			i++;
+		}
+	}
+
+	while (!result.text.empty() && result.text.back() == ' ') {
+		result.text.pop_back();
+	}
+
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (unsigned char c : result.text) {
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+
+	result.fingerprint = hash;
+	result.cacheable = true;
+	return result;
+}
+
+PlanCache::PlanCache(size_t capacity) : capacity(capacity), hit_count(0), miss_count(0) {}
+
+AST PlanCache::parse(const std::string& sql) {
+	NormalizedQuery query = normalize_query(sql);
+
+	if (!query.cacheable || capacity == 0) {
+		miss_count++;
+		return resolve(parse_uncached(sql));
+	}
+
+	auto it = entries.find(query.fingerprint);
+	if (it != entries.end() && it->second.first.normalized_text == query.text) {
+		hit_count++;
+		lru.splice(lru.begin(), lru, it->second.second);
+
+		AST statement = it->second.first.statement;
+		bind_parameters(statement, query.literals);
+		return resolve(std::move(statement));
+	}
+
+	miss_count++;
+
+	AST statement;
+	try {
+		statement = parse_uncached(query.text);
+	}
+	catch (const std::exception&) {
+		// a literal was in a place that does not accept a parameter, parse the query as written
+		return resolve(parse_uncached(sql));
+	}
+
+	if (it != entries.end()) {
+		lru.erase(it->second.second);
+		entries.erase(it);
+	}
+	else if (entries.size() >= capacity) {
+		entries.erase(lru.back());
+		lru.pop_back();
+	}
+
+	lru.push_front(query.fingerprint);
+	entries.emplace(query.fingerprint, std::make_pair(Entry{ query.text, statement }, lru.begin()));
+
+	bind_parameters(statement, query.literals);
+	return resolve(std::move(statement));
+}
+
+void PlanCache::clear() {
+	lru.clear();
+	entries.clear();
+	prepared.clear();
+}
+
+size_t PlanCache::hits() const {
+	return hit_count;
+}
+
+size_t PlanCache::misses() const {
+	return miss_count;
+}
+
+size_t PlanCache::size() const {
+	return entries.size();
+}
+
+size_t PlanCache::memory_bytes() const {
+	const size_t node = 4 * sizeof(void*);
+	size_t bytes = lru.size() * (node + sizeof(uint64_t));
+
+	for (auto& [fingerprint, entry] : entries) {
+		bytes += node + sizeof(fingerprint) + sizeof(entry) + entry.first.normalized_text.capacity();
+	}
+	for (auto& [name, statement] : prepared) {
+		bytes += node + sizeof(name) + name.capacity() + sizeof(statement);
+	}
+	return bytes;
+}
+
+AST PlanCache::parse_uncached(const std::string& sql) {
+	return parse_sql_to_ast(sql);
+}
+
+AST PlanCache::resolve(AST statement) {
+	if (auto* prepare = std::get_if<PrepareStatement>(&statement)) {
+		AST query = parse_uncached(prepare->query);
+
+		if (std::holds_alternative<PrepareStatement>(query) || std::holds_alternative<ExecuteStatement>(query)) {
+			throw std::runtime_error("PREPARE can not contain PREPARE or EXECUTE");
+		}
+
+		prepared[prepare->name] = std::move(query);
+		return statement;
+	}
+
+	if (auto* execute = std::get_if<ExecuteStatement>(&statement)) {
+		auto it = prepared.find(execute->name);
+		if (it == prepared.end()) {
+			throw std::runtime_error("Prepared statement " + execute->name + " does not exist");
+		}
+
+		AST bound = it->second;
+		bind_parameters(bound, execute->params);
+		return bound;
+	}
+
+	return statement;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+#include "ast.h"
+
+static const size_t PLAN_CACHE_CAPACITY = 256; // number of cached statement shapes
+
+// SQL text with every literal replaced by a $n parameter
+struct NormalizedQuery {
+	std::string text;
+	std::vector<std::string> literals; // literal values in parameter order
+	uint64_t fingerprint = 0; // hash of the normalized text
+	bool cacheable = false;
+};
+
+// Replace string and number literals of SELECT/INSERT/UPDATE/DELETE/EXECUTE statements with parameters
+NormalizedQuery normalize_query(const std::string& sql);
+
+/**
+ * Cache of parsed statements keyed by the fingerprint of the normalized query, so repeated
+ * query shapes that only differ in literals skip pg_query and the parse tree walk. Also keeps
+ * the statements created with PREPARE and binds their parameters on EXECUTE.
+ */
+class PlanCache {
+public:
+	explicit PlanCache(size_t capacity = PLAN_CACHE_CAPACITY);
+
+	// Parse through the cache. PREPARE is registered and returned as is, EXECUTE returns the bound prepared statement.
+	AST parse(const std::string& sql);
+
+	void clear();
+
+	size_t hits() const;
+	size_t misses() const;
+	size_t size() const;
+
+	// Estimated bytes of the cached and prepared statements: texts, list and map nodes and the AST objects,
+	// the expressions nested inside a statement are not followed
+	size_t memory_bytes() const;
+
+private:
+	struct Entry {
+		std::string normalized_text;
+		AST statement;
+	};
+
+	size_t capacity;
+	size_t hit_count;
+	size_t miss_count;
+
+	std::list<uint64_t> lru; // most recently used first
+	std::unordered_map<uint64_t, std::pair<Entry, std::list<uint64_t>::iterator>> entries;
+	std::unordered_map<std::string, AST> prepared;
+
+	AST parse_uncached(const std::string& sql);
+	AST resolve(AST statement);
+};
@@ -1,4 +1,35 @@
 #include "query_executor.h"
+#include "expression.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+#include <chrono>
+#include <iomanip>
+
+// Numbers are ordered numerically, everything else as strings
+static bool lessForOrder(const std::string& a, const std::string& b)
+{
+	char* a_end = nullptr;
+	char* b_end = nullptr;
+	double a_num = std::strtod(a.c_str(), &a_end);
+	double b_num = std::strtod(b.c_str(), &b_end);
+
+	if (!a.empty() && !b.empty() && *a_end == '\0' && *b_end == '\0') {
+		return a_num < b_num;
+	}
+	return a < b;
+}
+
+static std::string join_names(const std::vector<std::string>& names)
+{
+	std::string text;
+	for (size_t i = 0; i < names.size(); i++) {
+		text += (i > 0 ? ", " : "") + names[i];
+	}
+	return text;
+}
 
 std::vector<uint8_t> QueryExecutor::packRecord(const TableSchema& schema, const std::vector<std::string>& values)
 {
@@ -63,75 +94,302 @@ std::vector<std::string> QueryExecutor::unpackRecord(const TableSchema& schema,
 
 QueryExecutor::QueryExecutor(FileStorageLayer& s) : storage(s) {}
 
-int QueryExecutor::executeInsert(const InsertStatement& stmt)
+const StatementStats& QueryExecutor::statementStats() const
+{
+	return statement_stats;
+}
+
+std::optional<std::function<bool(const std::vector<uint8_t>&)>> QueryExecutor::makeWhereFilter(
+	const std::string& table,
+	const TableSchema& schema,
+	const std::optional<Expr>& where)
+{
+	std::optional<std::function<bool(const std::vector<uint8_t>&)>> filter_func;
+	if (!where) {
+		return filter_func;
+	}
+
+	TraceSpan span("filter", "plan");
+	span.arg("table", table);
+
+	auto stats = storage.get_table_stats(table);
+
+	CompiledFilter compiled(*where, schema, [&](const std::string& name) -> const ColumnStats* {
+		int index = find_column(schema, name);
+		return stats && index >= 0 && index < (int)stats->columns.size() ? &stats->columns[index] : nullptr;
+	});
+
+	filter_func = [compiled](const std::vector<uint8_t>& raw) {
+		return compiled(raw);
+	};
+
+	return filter_func;
+}
+
+AccessPath QueryExecutor::chooseAccessPath(
+	const std::string& table,
+	const TableSchema& schema,
+	const std::optional<Expr>& where,
+	bool allow_parallel)
+{
+	TraceSpan span("plan", "plan");
+	span.arg("table", table);
+
+	AccessPath path;
+	size_t pages = storage.page_count(table);
+
+	auto stats = storage.get_table_stats(table);
+	if (stats) {
+		path.estimated_rows = (double)stats->row_count;
+		if (where) {
+			*path.estimated_rows *= estimate_selectivity(*where, [&](const std::string& name) -> const ColumnStats* {
+				int index = find_column(schema, name);
+				return index >= 0 && index < (int)stats->columns.size() ? &stats->columns[index] : nullptr;
+			});
+		}
+	}
+
+	if (where) {
+		for (auto& term : split_conjuncts(*where)) {
+			if (term.type != "compare" || term.op != "=" || term.negated || term.values.size() != 1 || term.column != schema.columns[0].name) {
+				continue;
+			}
+
+			std::string key;
+			try {
+				key = value_to_string(parse_value(schema.columns[0], term.values[0]));
+			}
+			catch (const std::exception&) {
+				break; // the filter reports the invalid literal
+			}
+
+			// every record of the bucket costs a page read, a scan reads every page once
+			auto rids = storage.find(table, key);
+			if (rids.size() < pages) {
+				path.method = AccessPath::Method::Index;
+				path.index_key = key;
+				path.index_rids = std::move(rids);
+				return path;
+			}
+			break;
+		}
+	}
+
+	path.method = allow_parallel && pages >= (size_t)PARALLEL_SCAN_MIN_PAGES ? AccessPath::Method::Parallel : AccessPath::Method::Seq;
+	return path;
+}
+
+std::vector<std::pair<int, std::vector<uint8_t>>> QueryExecutor::indexLookup(
+	const std::string& table,
+	const AccessPath& path,
+	const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func)
 {
+	TraceSpan span("index_lookup", "scan");
+	span.arg("table", table);
+	span.arg("bucket_records", (int64_t)path.index_rids.size());
+
+	// the bucket also holds other keys with the same hash, the filter compares the key itself
+	std::vector<std::pair<int, std::vector<uint8_t>>> records;
+
+	for (int record_id : path.index_rids) {
+		auto raw = storage.get(table, record_id);
+		if (raw.empty() || (filter_func && !(*filter_func)(raw))) {
+			continue;
+		}
+		records.emplace_back(record_id, std::move(raw));
+	}
+
+	return records;
+}
+
+PlanNode QueryExecutor::scanNode(const std::string& table, const AccessPath& path, const std::optional<Expr>& where)
+{
+	PlanNode node;
+
+	switch (path.method) {
+	case AccessPath::Method::Index:
+		node.name = "Index Lookup on " + table;
+		node.details.push_back("Index Key: " + path.index_key + " (" + std::to_string(path.index_rids.size()) + " records in bucket)");
+		break;
+	case AccessPath::Method::Parallel:
+		node.name = "Parallel Seq Scan on " + table;
+		node.details.push_back("Workers: " + std::to_string(storage.scan_workers()));
+		break;
+	default:
+		node.name = "Seq Scan on " + table;
+		break;
+	}
+
+	if (where) {
+		node.details.push_back("Filter: " + expr_to_string(*where));
+	}
+	node.estimated_rows = path.estimated_rows;
+	return node;
+}
+
+void QueryExecutor::finishScan(PlanNode& node, const std::string& table, const AccessPath& path, const ScanCounters& counters, size_t rows, PlanClock::time_point start)
+{
+	node.rows = rows;
+	node.pages = path.method == AccessPath::Method::Index ? path.index_rids.size() : storage.page_count(table);
+	node.bytes = counters.bytes;
+	node.time_ms = elapsed_ms(start);
+
+	statement_stats.access_paths.push_back(node.name);
+	statement_stats.rows_scanned += counters.records;
+}
+
+std::optional<std::function<bool(const std::vector<uint8_t>&)>> QueryExecutor::countRecords(
+	const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func,
+	ScanCounters& counters)
+{
+	if (plan == nullptr && !storage.slow_log().enabled()) {
+		return filter_func;
+	}
+
+	return [filter_func, &counters](const std::vector<uint8_t>& raw) {
+		counters.records++;
+		counters.bytes += raw.size();
+		return !filter_func || (*filter_func)(raw);
+	};
+}
+
+std::optional<std::function<bool(const std::vector<uint8_t>&)>> QueryExecutor::reserveRecords(
+	const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func,
+	MemoryReservation& reservation)
+{
+	return [filter_func, &reservation](const std::vector<uint8_t>& raw) {
+		if (filter_func && !(*filter_func)(raw)) {
+			return false;
+		}
+		reservation.grow(record_bytes(raw));
+		return true;
+	};
+}
+
+static size_t value_bytes(const Value& value)
+{
+	auto text = std::get_if<std::string>(&value);
+	return sizeof(Value) + (text && text->capacity() > std::string().capacity() ? text->capacity() + 1 : 0);
+}
+
+// Hash table entry of a group: the node, key values and aggregate states
+static size_t group_bytes(const std::vector<Value>& key, size_t aggregates)
+{
+	size_t bytes = 4 * sizeof(void*) + sizeof(key) + sizeof(std::vector<AggregateState>) + aggregates * sizeof(AggregateState);
+	for (auto& value : key) {
+		bytes += value_bytes(value);
+	}
+	return bytes;
+}
+
+std::vector<int> QueryExecutor::executeInsert(const InsertStatement& stmt)
+{
+	LatencyTimer timer(storage.latencies(), LatencyOp::SqlInsert);
+	TraceSpan span("insert", "sql");
+	span.arg("table", stmt.table_name);
+
 	auto schema = storage.get_table_schema(stmt.table_name);
 	if (schema.columns.empty()) {
 		throw std::runtime_error("Table schema not found for " + stmt.table_name);
 	}
 
-	auto packedRecord = packRecord(schema, stmt.values);
-	if (packedRecord.empty()) {
+	if (stmt.rows.empty()) {
 		throw std::runtime_error("No values provided for insert into " + stmt.table_name);
 	}
-	return storage.insert(stmt.table_name, packedRecord);
+
+	std::vector<std::vector<uint8_t>> packedRecords;
+	packedRecords.reserve(stmt.rows.size());
+
+	for (auto& values : stmt.rows) {
+		auto packedRecord = packRecord(schema, values);
+		if (packedRecord.empty()) {
+			throw std::runtime_error("No values provided for insert into " + stmt.table_name);
+		}
+		packedRecords.push_back(std::move(packedRecord));
+	}
+
+	std::vector<int> ids;
+	if (packedRecords.size() == 1) {
+		ids.push_back(storage.insert(stmt.table_name, packedRecords[0]));
+	}
+	else {
+		ids = storage.insert_many(stmt.table_name, packedRecords);
+	}
+
+	// failed records come back as -1
+	statement_stats.rows_returned += std::count_if(ids.begin(), ids.end(), [](int id) { return id >= 0; });
+	return ids;
 };
 
 std::vector<std::vector<std::string>> QueryExecutor::executeSelect(const SelectStatement& stmt)
 {
+	LatencyTimer timer(storage.latencies(), LatencyOp::SqlSelect);
+	TraceSpan span("select", "sql");
+	span.arg("table", stmt.table_name);
+
 	auto schema = storage.get_table_schema(stmt.table_name);
 	if(schema.columns.empty()) {
 		throw std::runtime_error("Table schema not found for " + stmt.table_name);
 	}
 
+	if (stmt.join) {
+		return executeJoin(stmt);
+	}
 
-	std::optional<std::function<bool(const std::vector<uint8_t>&)>> filter_func;
-	if (stmt.where_column) {
-		int index = -1;
-		for (int i = 0; i < (int)schema.columns.size(); i++) {
-			if (schema.columns[i].name == *stmt.where_column) {
-				index = i;
-				break;
-			}
-		}
+	auto filter_func = makeWhereFilter(stmt.table_name, schema, stmt.where);
 
-		if (index < 0) {
-			throw std::runtime_error("Unknown WHERE column");
-		}
+	if (!stmt.aggregates.empty() || !stmt.group_by.empty()) {
+		return executeAggregate(stmt, schema, filter_func);
+	}
 
-		filter_func = [=](auto& raw) {
-			auto fields = unpackRecord(schema, raw);
-			auto& fv = fields[index];
+	AccessPath path = chooseAccessPath(stmt.table_name, schema, stmt.where, !stmt.limit);
 
-			if (*stmt.where_operator == ">") {
-				return fv > *stmt.where_value;
-			}
+	PlanNode scan_node = scanNode(stmt.table_name, path, stmt.where);
+	PlanNode project_node{ "Project" };
+	PlanNode sort_node{ "Sort" };
 
-			if (*stmt.where_operator == "<") {
-				return fv < *stmt.where_value;
-			}
+	project_node.details.push_back("Output: " + (stmt.columns.empty() ? std::string("*") : join_names(stmt.columns)));
+	if (stmt.limit) {
+		project_node.details.push_back("Limit: " + std::to_string(*stmt.limit));
+	}
+	if (stmt.order_by_column) {
+		sort_node.details.push_back("Sort Key: " + *stmt.order_by_column);
+		sort_node.details.push_back("Strategy: in-memory sort, string order");
+	}
 
-			if (*stmt.where_operator == "=") {
-				return fv == *stmt.where_value;
-			}
+	auto record_plan = [&]() {
+		std::vector<PlanNode> operators;
+		if (stmt.order_by_column) {
+			operators.push_back(std::move(sort_node));
+		}
+		operators.push_back(std::move(project_node));
+		operators.push_back(std::move(scan_node));
+		*plan = stack_plan(std::move(operators));
+	};
 
-			if (*stmt.where_operator == "<=") {
-				return fv <= *stmt.where_value;
-			}
+	if (plan_only) {
+		record_plan();
+		return {};
+	}
 
-			if (*stmt.where_operator == ">=") {
-				return fv >= *stmt.where_value;
-			}
+	auto start = PlanClock::now();
+	ScanCounters counters;
+	MemoryReservation memory(storage.memory(), "SELECT on " + stmt.table_name);
+	auto scan_filter = reserveRecords(countRecords(filter_func, counters), memory);
 
-			if (*stmt.where_operator == "!=") {
-				return fv != *stmt.where_value;
-			}
-
-			return false;
-		};
+	std::vector<std::vector<uint8_t>> raws;
+	if (path.method == AccessPath::Method::Index) {
+		for (auto& [record_id, raw] : indexLookup(stmt.table_name, path, scan_filter)) {
+			raws.push_back(std::move(raw));
+		}
 	}
-
-	auto raws = storage.scan(stmt.table_name, std::nullopt, std::nullopt, filter_func);
+	else if (path.method == AccessPath::Method::Parallel) {
+		raws = storage.parallel_scan(stmt.table_name, scan_filter);
+	}
+	else {
+		raws = storage.scan(stmt.table_name, std::nullopt, std::nullopt, scan_filter);
+	}
+	finishScan(scan_node, stmt.table_name, path, counters, raws.size(), start);
 
 	std::vector<std::vector<std::string>> rows;
 	for (auto& r : raws) {
@@ -144,9 +402,11 @@ std::vector<std::vector<std::string>> QueryExecutor::executeSelect(const SelectS
 				pr.push_back(all[index]);
 			}
 
+			memory.grow(row_bytes(pr));
 			rows.push_back(std::move(pr));
 		}
 		else {
+			memory.grow(row_bytes(all));
 			rows.push_back(std::move(all));
 		}
 
@@ -154,8 +414,11 @@ std::vector<std::vector<std::string>> QueryExecutor::executeSelect(const SelectS
 			break;
 		}
 	}
+	project_node.rows = rows.size();
+	project_node.time_ms = elapsed_ms(start);
 
 	if (stmt.order_by_column) {
+		TraceSpan span("sort", "sql");
 		int col_index = std::distance(stmt.columns.begin(),
 			std::find(stmt.columns.begin(), stmt.columns.end(), *stmt.order_by_column));
 
@@ -164,101 +427,999 @@ std::vector<std::vector<std::string>> QueryExecutor::executeSelect(const SelectS
 				[&](auto& a, auto& b) {return a[col_index] < b[col_index]; });
 		}
 	}
+	sort_node.rows = rows.size();
+	sort_node.time_ms = elapsed_ms(start);
 
+	if (plan) {
+		record_plan();
+	}
+
+	statement_stats.rows_returned += rows.size();
 	return rows;
 }
 
 size_t QueryExecutor::executeDelete(const DeleteStatement& stmt)
 {
+	LatencyTimer timer(storage.latencies(), LatencyOp::SqlDelete);
+	TraceSpan span("delete", "sql");
+	span.arg("table", stmt.table_name);
+
 	auto schema = storage.get_table_schema(stmt.table_name);
 	if (schema.columns.empty()) {
 		throw std::runtime_error("Table schema not found for " + stmt.table_name);
 	}
 
-	std::optional<std::function<bool(const std::vector<uint8_t>&)>> filter_func;
-	if (stmt.where_column) {
-		int index = -1;
+	auto filter_func = makeWhereFilter(stmt.table_name, schema, stmt.where);
+	AccessPath path = chooseAccessPath(stmt.table_name, schema, stmt.where, true);
+
+	PlanNode delete_node{ "Delete on " + stmt.table_name };
+	PlanNode scan_node = scanNode(stmt.table_name, path, stmt.where);
+
+	if (plan_only) {
+		*plan = stack_plan({ std::move(delete_node), std::move(scan_node) });
+		return 0;
+	}
+
+	auto start = PlanClock::now();
+	ScanCounters counters;
+	auto scan_filter = countRecords(filter_func, counters);
+
+	std::vector<int> ids;
+	if (path.method == AccessPath::Method::Index) {
+		for (auto& [record_id, raw] : indexLookup(stmt.table_name, path, scan_filter)) {
+			ids.push_back(record_id);
+		}
+	}
+	else if (path.method == AccessPath::Method::Parallel) {
+		std::vector<std::vector<int>> worker_ids(storage.scan_workers());
+
+		storage.parallel_visit(
+			stmt.table_name,
+			[&](size_t worker, int record_id, const std::vector<uint8_t>&) {
+				worker_ids[worker].push_back(record_id);
+			},
+			scan_filter
+		);
+
+		for (auto& worker : worker_ids) {
+			ids.insert(ids.end(), worker.begin(), worker.end());
+		}
+	}
+	else {
+		storage.scan(
+			stmt.table_name,
+			[&](int record_id, const std::vector<uint8_t>&) {
+				ids.push_back(record_id);
+				return false;
+			},
+			std::nullopt,
+			scan_filter
+		);
+	}
+	finishScan(scan_node, stmt.table_name, path, counters, ids.size(), start);
+
+	size_t deleted = storage.delete_many(stmt.table_name, ids);
+
+	if (plan) {
+		delete_node.rows = deleted;
+		delete_node.time_ms = elapsed_ms(start);
+		*plan = stack_plan({ std::move(delete_node), std::move(scan_node) });
+	}
+
+	statement_stats.rows_returned += deleted;
+	return deleted;
+}
+
+size_t QueryExecutor::executeUpdate(const UpdateStatement& stmt)
+{
+	LatencyTimer timer(storage.latencies(), LatencyOp::SqlUpdate);
+	TraceSpan span("update", "sql");
+	span.arg("table", stmt.table_name);
+
+	auto schema = storage.get_table_schema(stmt.table_name);
+	if (schema.columns.empty()) {
+		throw std::runtime_error("Table schema not found for " + stmt.table_name);
+	}
+
+	std::vector<std::pair<int, Value>> assignments;
+	bool fixed_size = true;
+
+	for (auto& [column, literal] : stmt.assignments) {
+		int index = find_column(schema, column);
+		if (index < 0) {
+			throw std::runtime_error("Unknown SET column: " + column);
+		}
+		assignments.emplace_back(index, parse_value(schema.columns[index], literal));
+
+		if (schema.columns[index].type != DataType::INT) {
+			fixed_size = false;
+		}
+	}
+
+	auto filter_func = makeWhereFilter(stmt.table_name, schema, stmt.where);
+
+	// the matching records are rewritten during the scan, one pass over the pages
+	PlanNode update_node{ "Update on " + stmt.table_name };
+	for (auto& [column, literal] : stmt.assignments) {
+		update_node.details.push_back("Set: " + column + " = " + literal);
+	}
+	update_node.details.push_back(fixed_size ? "Strategy: in-place write of INT columns" : "Strategy: re-encode records");
+	AccessPath path = chooseAccessPath(stmt.table_name, schema, stmt.where, false);
+	path.method = AccessPath::Method::Seq;
+	PlanNode scan_node = scanNode(stmt.table_name, path, stmt.where);
+
+	if (plan_only) {
+		*plan = stack_plan({ std::move(update_node), std::move(scan_node) });
+		return 0;
+	}
+
+	auto start = PlanClock::now();
+	ScanCounters counters;
+
+	size_t updated = storage.update_where(stmt.table_name, countRecords(filter_func, counters), [&](std::vector<uint8_t>& record) {
+		auto offsets = column_offsets(schema, record);
+
+		if (fixed_size) {
+			// INT columns keep their size, the new values are written over the old bytes
+			for (auto& [index, value] : assignments) {
+				int val = std::get<int>(value);
+				std::memcpy(record.data() + offsets[index], &val, sizeof(int));
+			}
+			return true;
+		}
+
+		std::vector<Value> values;
+		for (size_t i = 0; i < schema.columns.size(); i++) {
+			values.push_back(read_value(schema.columns[i], record, offsets[i]));
+		}
+		for (auto& [index, value] : assignments) {
+			values[index] = value;
+		}
+
+		record.clear();
+		for (size_t i = 0; i < schema.columns.size(); i++) {
+			write_value(schema.columns[i], values[i], record);
+		}
+		return true;
+	});
+
+	finishScan(scan_node, stmt.table_name, path, counters, updated, start);
+	statement_stats.rows_returned += updated;
+
+	if (plan) {
+		update_node.rows = updated;
+		update_node.time_ms = scan_node.time_ms;
+		*plan = stack_plan({ std::move(update_node), std::move(scan_node) });
+	}
+
+	return updated;
+}
+
+int QueryExecutor::executeCreateTableAs(const CTASStatement& stmt)
+{
+	const SelectStatement& select = stmt.selectStmt;
+
+	if (select.join || !select.aggregates.empty() || !select.group_by.empty()) {
+		throw std::runtime_error("CREATE TABLE AS supports only single table SELECT without aggregates");
+	}
+
+	auto schema = storage.get_table_schema(select.table_name);
+	if (schema.columns.empty()) {
+		throw std::runtime_error("Source table not found");
+	}
+
+	// the new table gets the schema of the projected columns
+	std::vector<int> projection;
+	TableSchema new_schema;
+
+	if (select.columns.empty()) {
 		for (int i = 0; i < (int)schema.columns.size(); i++) {
-			if (schema.columns[i].name == *stmt.where_column) {
-				index = i;
-				break;
+			projection.push_back(i);
+		}
+	}
+	else {
+		for (auto& column : select.columns) {
+			int index = find_column(schema, column);
+			if (index < 0) {
+				throw std::runtime_error("Unknown column: " + column);
 			}
+			projection.push_back(index);
 		}
+	}
+
+	for (int index : projection) {
+		new_schema.columns.push_back(schema.columns[index]);
+	}
+
+	auto filter_func = makeWhereFilter(select.table_name, schema, select.where);
+
+	// checked before the table is created, a failed statement leaves no table behind
+	int order_index = -1;
+	if (select.order_by_column) {
+		order_index = find_column(new_schema, *select.order_by_column);
+		if (order_index < 0) {
+			throw std::runtime_error("Unknown ORDER BY column: " + *select.order_by_column);
+		}
+	}
+
+	if (!storage.create_table(stmt.table_name, new_schema)) {
+		throw std::runtime_error("Could not create table: " + stmt.table_name);
+	}
+
+	BulkLoader loader(storage, stmt.table_name);
+
+	if (select.order_by_column) {
+		// sorting needs all projected records, they stay packed and are ordered by the typed value
+		std::vector<std::pair<Value, std::vector<uint8_t>>> records;
+		storage.scan(
+			select.table_name,
+			[&](int, const std::vector<uint8_t>& raw) {
+				auto projected = project_record(schema, raw, projection);
+				Value key = read_column(new_schema, projected, order_index);
+				records.emplace_back(std::move(key), std::move(projected));
+				return false;
+			},
+			std::nullopt,
+			filter_func
+		);
+
+		std::stable_sort(records.begin(), records.end(), [](auto& a, auto& b) { return a.first < b.first; });
+
+		if (select.limit && records.size() > *select.limit) {
+			records.resize(*select.limit);
+		}
+
+		for (auto& record : records) {
+			loader.append(record.second);
+		}
+	}
+	else {
+		// stream packed records from the source scan straight into the page writer, the scan stops at the LIMIT
+		if (select.limit && *select.limit == 0) {
+			return (int)loader.finish();
+		}
+
+		size_t streamed = 0;
+		storage.scan_while(
+			select.table_name,
+			[&](int, const std::vector<uint8_t>& raw) {
+				if (loader.append(project_record(schema, raw, projection))) {
+					streamed++;
+				}
+				return !select.limit || streamed < *select.limit;
+			},
+			filter_func
+		);
+	}
+
+	return (int)loader.finish();
+};
+
+static std::string finalizeAggregate(const AggregateExpr& agg, const AggregateState& state)
+{
+	if (agg.function == "count") {
+		return std::to_string(state.count);
+	}
 
+	if (state.count == 0) {
+		return "NULL";
+	}
+
+	if (agg.function == "sum") {
+		return std::to_string(state.sum);
+	}
+
+	if (agg.function == "min") {
+		return value_to_string(*state.min);
+	}
+
+	if (agg.function == "max") {
+		return value_to_string(*state.max);
+	}
+
+	std::ostringstream avg;
+	avg << (double)state.sum / state.count;
+	return avg.str();
+}
+
+std::vector<std::vector<std::string>> QueryExecutor::executeAggregate(
+	const SelectStatement& stmt,
+	const TableSchema& schema,
+	const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func)
+{
+	if (stmt.columns.empty()) {
+		throw std::runtime_error("SELECT * is not supported together with GROUP BY");
+	}
+
+	std::vector<int> group_indexes;
+	for (auto& column : stmt.group_by) {
+		int index = find_column(schema, column);
 		if (index < 0) {
-			throw std::runtime_error("Unknown WHERE column");
+			throw std::runtime_error("Unknown GROUP BY column: " + column);
 		}
+		group_indexes.push_back(index);
+	}
 
-		filter_func = [=](auto& raw) {
-			auto fields = unpackRecord(schema, raw);
-			auto& fv = fields[index];
+	std::vector<int> agg_indexes;
+	for (auto& agg : stmt.aggregates) {
+		int index = -1;
+		if (!agg.column.empty()) {
+			index = find_column(schema, agg.column);
+			if (index < 0) {
+				throw std::runtime_error("Unknown aggregate column: " + agg.column);
+			}
+			if ((agg.function == "sum" || agg.function == "avg") && schema.columns[index].type != DataType::INT) {
+				throw std::runtime_error(agg.function + " cannot be applied to VARCHAR column " + agg.column);
+			}
+		}
+		agg_indexes.push_back(index);
+	}
+
+	// every plain output column has to be a grouping column
+	for (auto& column : stmt.columns) {
+		bool is_aggregate = std::any_of(stmt.aggregates.begin(), stmt.aggregates.end(), [&](auto& a) {return a.label == column; });
+		if (!is_aggregate && std::find(stmt.group_by.begin(), stmt.group_by.end(), column) == stmt.group_by.end()) {
+			throw std::runtime_error("Column " + column + " must appear in the GROUP BY clause or be used in an aggregate function");
+		}
+	}
+
+	using GroupMap = std::unordered_map<std::vector<Value>, std::vector<AggregateState>, ValueVectorHash>;
+
+	MemoryReservation memory(storage.memory(), "aggregation on " + stmt.table_name);
+
+	auto accumulate = [&](GroupMap& groups, const std::vector<uint8_t>& raw) {
+		auto offsets = column_offsets(schema, raw);
+
+		std::vector<Value> key;
+		key.reserve(group_indexes.size());
+		for (int index : group_indexes) {
+			key.push_back(read_value(schema.columns[index], raw, offsets[index]));
+		}
 
-			if (*stmt.where_operator == ">") {
-				return fv > *stmt.where_value;
+		auto [group, inserted] = groups.try_emplace(std::move(key));
+		if (inserted) {
+			group->second.resize(stmt.aggregates.size());
+			memory.grow(group_bytes(group->first, stmt.aggregates.size()));
+		}
+		auto& states = group->second;
+
+		for (size_t i = 0; i < states.size(); i++) {
+			auto& state = states[i];
+			state.count++;
+
+			if (agg_indexes[i] < 0) {
+				continue;
 			}
 
-			if (*stmt.where_operator == "<") {
-				return fv < *stmt.where_value;
+			Value value = read_value(schema.columns[agg_indexes[i]], raw, offsets[agg_indexes[i]]);
+			if (std::holds_alternative<int>(value)) {
+				state.sum += std::get<int>(value);
+			}
+			if (!state.min || value < *state.min) {
+				state.min = value;
 			}
+			if (!state.max || *state.max < value) {
+				state.max = value;
+			}
+		}
+	};
+
+	AccessPath path = chooseAccessPath(stmt.table_name, schema, stmt.where, true);
+
+	PlanNode scan_node = scanNode(stmt.table_name, path, stmt.where);
+	PlanNode aggregate_node{ path.method == AccessPath::Method::Parallel ? "Parallel Hash Aggregate" : "Hash Aggregate" };
+	PlanNode sort_node{ "Sort" };
+	PlanNode limit_node{ "Limit" };
+
+	if (!stmt.group_by.empty()) {
+		aggregate_node.details.push_back("Group Key: " + join_names(stmt.group_by));
+	}
+	std::vector<std::string> labels;
+	for (auto& agg : stmt.aggregates) {
+		labels.push_back(agg.label);
+	}
+	if (!labels.empty()) {
+		aggregate_node.details.push_back("Aggregates: " + join_names(labels));
+	}
+	if (stmt.order_by_column) {
+		sort_node.details.push_back("Sort Key: " + *stmt.order_by_column);
+		sort_node.details.push_back("Strategy: in-memory sort, numeric order for numbers");
+	}
+	if (stmt.limit) {
+		limit_node.details.push_back("Rows: " + std::to_string(*stmt.limit));
+	}
+
+	auto record_plan = [&]() {
+		std::vector<PlanNode> operators;
+		if (stmt.limit) {
+			operators.push_back(std::move(limit_node));
+		}
+		if (stmt.order_by_column) {
+			operators.push_back(std::move(sort_node));
+		}
+		operators.push_back(std::move(aggregate_node));
+		operators.push_back(std::move(scan_node));
+		*plan = stack_plan(std::move(operators));
+	};
+
+	if (plan_only) {
+		record_plan();
+		return {};
+	}
+
+	auto start = PlanClock::now();
+	ScanCounters counters;
+	auto scan_filter = countRecords(filter_func, counters);
+	std::atomic<size_t> matched{ 0 };
+
+	GroupMap groups;
+
+	if (stmt.group_by.empty()) {
+		groups[{}].resize(stmt.aggregates.size()); // a global aggregate returns one row even for an empty table
+	}
+
+	// aggregate on typed values while scanning, no rows are materialized
+	if (path.method == AccessPath::Method::Index) {
+		for (auto& [record_id, raw] : indexLookup(stmt.table_name, path, scan_filter)) {
+			accumulate(groups, raw);
+			matched++;
+		}
+		finishScan(scan_node, stmt.table_name, path, counters, matched, start);
+	}
+	else if (path.method == AccessPath::Method::Parallel) {
+		// every worker aggregates into its own hash table, the tables are merged afterwards
+		std::vector<GroupMap> worker_groups(storage.scan_workers());
+
+		storage.parallel_visit(
+			stmt.table_name,
+			[&](size_t worker, int, const std::vector<uint8_t>& raw) {
+				accumulate(worker_groups[worker], raw);
+				if (plan) {
+					matched++;
+				}
+			},
+			scan_filter
+		);
+		finishScan(scan_node, stmt.table_name, path, counters, matched, start);
 
-			if (*stmt.where_operator == "=") {
-				return fv == *stmt.where_value;
+		for (auto& worker : worker_groups) {
+			for (auto& [key, states] : worker) {
+				auto& merged = groups[key];
+				merged.resize(states.size());
+
+				for (size_t i = 0; i < states.size(); i++) {
+					merged[i].count += states[i].count;
+					merged[i].sum += states[i].sum;
+					if (states[i].min && (!merged[i].min || *states[i].min < *merged[i].min)) {
+						merged[i].min = states[i].min;
+					}
+					if (states[i].max && (!merged[i].max || *merged[i].max < *states[i].max)) {
+						merged[i].max = states[i].max;
+					}
+				}
 			}
+		}
+	}
+	else {
+		storage.scan(
+			stmt.table_name,
+			[&](int, const std::vector<uint8_t>& raw) {
+				accumulate(groups, raw);
+				matched++;
+				return false;
+			},
+			std::nullopt,
+			scan_filter
+		);
+		finishScan(scan_node, stmt.table_name, path, counters, matched, start);
+	}
 
-			if (*stmt.where_operator == "<=") {
-				return fv <= *stmt.where_value;
+	std::vector<std::vector<std::string>> rows;
+	for (auto& [key, states] : groups) {
+		std::vector<std::string> row;
+		for (auto& column : stmt.columns) {
+			auto agg_it = std::find_if(stmt.aggregates.begin(), stmt.aggregates.end(), [&](auto& a) {return a.label == column; });
+			if (agg_it != stmt.aggregates.end()) {
+				size_t i = std::distance(stmt.aggregates.begin(), agg_it);
+				row.push_back(finalizeAggregate(*agg_it, states[i]));
 			}
+			else {
+				size_t g = std::distance(stmt.group_by.begin(), std::find(stmt.group_by.begin(), stmt.group_by.end(), column));
+				row.push_back(value_to_string(key[g]));
+			}
+		}
+		rows.push_back(std::move(row));
+	}
+	aggregate_node.rows = rows.size();
+	aggregate_node.time_ms = elapsed_ms(start);
+
+	if (stmt.order_by_column) {
+		TraceSpan span("sort", "sql");
+		auto it = std::find(stmt.columns.begin(), stmt.columns.end(), *stmt.order_by_column);
+		if (it != stmt.columns.end()) {
+			size_t col_index = std::distance(stmt.columns.begin(), it);
+			std::sort(rows.begin(), rows.end(),
+				[&](auto& a, auto& b) {return lessForOrder(a[col_index], b[col_index]); });
+		}
+	}
+	sort_node.rows = rows.size();
+	sort_node.time_ms = elapsed_ms(start);
+
+	if (stmt.limit && rows.size() > *stmt.limit) {
+		rows.resize(*stmt.limit);
+	}
+	limit_node.rows = rows.size();
+	limit_node.time_ms = elapsed_ms(start);
+
+	if (plan) {
+		record_plan();
+	}
+
+	statement_stats.rows_returned += rows.size();
+	return rows;
+}
+
+// Column of one side of a join, side 0 is the FROM table and side 1 the joined table
+struct JoinColumn {
+	int side;
+	int index;
+};
+
+std::vector<std::vector<std::string>> QueryExecutor::executeJoin(const SelectStatement& stmt)
+{
+	using RecordVisitor = std::function<void(const std::vector<uint8_t>&)>;
+
+	const JoinClause& join = *stmt.join;
 
-			if (*stmt.where_operator == ">=") {
-				return fv >= *stmt.where_value;
+	if (!stmt.aggregates.empty() || !stmt.group_by.empty()) {
+		throw std::runtime_error("Aggregates over joins are not supported");
+	}
+
+	std::string tables[2] = { stmt.table_name, join.table_name };
+	std::string aliases[2] = { join.left_alias.value_or(tables[0]), join.right_alias.value_or(tables[1]) };
+	TableSchema schemas[2] = { storage.get_table_schema(tables[0]), storage.get_table_schema(tables[1]) };
+
+	for (int side = 0; side < 2; side++) {
+		if (schemas[side].columns.empty()) {
+			throw std::runtime_error("Table schema not found for " + tables[side]);
+		}
+	}
+
+	auto resolve = [&](const std::string& name) {
+		auto dot = name.find('.');
+		if (dot != std::string::npos) {
+			std::string qualifier = name.substr(0, dot);
+			std::string column = name.substr(dot + 1);
+
+			for (int side = 0; side < 2; side++) {
+				if (qualifier == aliases[side] || qualifier == tables[side]) {
+					int index = find_column(schemas[side], column);
+					if (index < 0) {
+						throw std::runtime_error("Unknown column: " + name);
+					}
+					return JoinColumn{ side, index };
+				}
 			}
+			throw std::runtime_error("Unknown table in column reference: " + name);
+		}
+
+		int left = find_column(schemas[0], name);
+		int right = find_column(schemas[1], name);
+
+		if (left >= 0 && right >= 0) {
+			throw std::runtime_error("Column reference is ambiguous: " + name);
+		}
+		if (left >= 0) {
+			return JoinColumn{ 0, left };
+		}
+		if (right >= 0) {
+			return JoinColumn{ 1, right };
+		}
+		throw std::runtime_error("Unknown column: " + name);
+	};
 
-			if (*stmt.where_operator == "!=") {
-				return fv != *stmt.where_value;
+	JoinColumn keys[2] = { resolve(join.left_column), resolve(join.right_column) };
+	if (keys[0].side == keys[1].side) {
+		throw std::runtime_error("Join condition has to compare columns of both tables");
+	}
+	if (keys[0].side == 1) {
+		std::swap(keys[0], keys[1]);
+	}
+	if (schemas[0].columns[keys[0].index].type != schemas[1].columns[keys[1].index].type) {
+		throw std::runtime_error("Join columns have different types");
+	}
+
+	std::vector<JoinColumn> output;
+	if (stmt.columns.empty()) {
+		for (int side = 0; side < 2; side++) {
+			for (int i = 0; i < (int)schemas[side].columns.size(); i++) {
+				output.push_back({ side, i });
 			}
+		}
+	}
+	else {
+		for (auto& column : stmt.columns) {
+			output.push_back(resolve(column));
+		}
+	}
 
-			return false;
-		};
+	bool left_join = join.type == "left";
+
+	// WHERE terms that only reference one table are pushed into the scan of that table, terms over
+	// both tables or over the optional side of a LEFT JOIN are applied to the joined rows
+	std::optional<TableStats> stats[2] = { storage.get_table_stats(tables[0]), storage.get_table_stats(tables[1]) };
+
+	auto column_stats = [&](const std::string& name) -> const ColumnStats* {
+		JoinColumn column = resolve(name);
+		auto& side_stats = stats[column.side];
+		return side_stats && column.index < (int)side_stats->columns.size() ? &side_stats->columns[column.index] : nullptr;
+	};
+
+	std::optional<std::function<bool(const std::vector<uint8_t>&)>> side_filters[2];
+	std::vector<Expr> side_terms[2];
+	std::optional<CompiledFilter> post_filter;
+	std::vector<Expr> post_terms;
+	if (stmt.where) {
+
+		for (auto& term : split_conjuncts(*stmt.where)) {
+			std::vector<std::string> columns;
+			collect_columns(term, columns);
+
+			bool sides[2] = { false, false };
+			for (auto& column : columns) {
+				sides[resolve(column).side] = true;
+			}
+
+			if (sides[0] && !sides[1]) {
+				side_terms[0].push_back(term);
+			}
+			else if (sides[1] && !sides[0] && !left_join) {
+				side_terms[1].push_back(term);
+			}
+			else {
+				post_terms.push_back(term);
+			}
+		}
+
+		for (int side = 0; side < 2; side++) {
+			if (side_terms[side].empty()) {
+				continue;
+			}
+
+			CompiledFilter compiled(make_conjunction(side_terms[side]), { &schemas[side] }, [&](const std::string& name) {
+				return std::make_pair(0, resolve(name).index);
+			}, column_stats);
+			side_filters[side] = [compiled](const std::vector<uint8_t>& raw) { return compiled(raw); };
+		}
+
+		if (!post_terms.empty()) {
+			post_filter.emplace(make_conjunction(post_terms), std::vector<const TableSchema*>{ &schemas[0], &schemas[1] }, [&](const std::string& name) {
+				JoinColumn column = resolve(name);
+				return std::make_pair(column.side, column.index);
+			}, column_stats);
+		}
 	}
 
-	std::vector<int> ids;
-	storage.scan(
-		stmt.table_name, 
-		[&](int record_id, const std::vector<uint8_t>& raw) {
-			ids.push_back(record_id);
-			return true;
-		}, 
-		std::nullopt,
-		filter_func
-	);
+	// the hash table is built on the smaller input: rows left after the pushed down filters
+	// when both tables were analyzed, otherwise the table with fewer pages
+	size_t pages[2] = { storage.page_count(tables[0]), storage.page_count(tables[1]) };
+	int build = pages[1] <= pages[0] ? 1 : 0;
 
-	size_t deleted = 0;
-	for (int id : ids) {
-		if (storage.delete_record(stmt.table_name, id)) {
-			deleted++;
+	if (stats[0] && stats[1]) {
+		double estimated_rows[2];
+		for (int side = 0; side < 2; side++) {
+			estimated_rows[side] = (double)stats[side]->row_count;
+			if (!side_terms[side].empty()) {
+				estimated_rows[side] *= estimate_selectivity(make_conjunction(side_terms[side]), column_stats);
+			}
 		}
+		build = estimated_rows[1] <= estimated_rows[0] ? 1 : 0;
 	}
-	return deleted;
+	int probe = 1 - build;
+
+	// a build side that may not fit into the memory left under the limit is partitioned as well
+	bool spill = pages[build] > (size_t)JOIN_SPILL_PAGES || pages[build] * PAGE_SIZE > storage.memory().available();
+
+	PlanNode join_node{ left_join ? "Hash Left Join" : "Hash Join" };
+	PlanNode side_nodes[2];
+	PlanNode sort_node{ "Sort" };
+	PlanNode limit_node{ "Limit" };
+
+	join_node.details.push_back("Hash Cond: " + join.left_column + " = " + join.right_column);
+	join_node.details.push_back("Build Side: " + aliases[build]);
+	join_node.details.push_back(spill
+		? "Strategy: grace hash join, " + std::to_string(JOIN_PARTITIONS) + " partitions spilled to disk"
+		: std::string("Strategy: in-memory hash table"));
+	if (!post_terms.empty()) {
+		join_node.details.push_back("Join Filter: " + expr_to_string(make_conjunction(post_terms)));
+	}
+
+	for (int side = 0; side < 2; side++) {
+		side_nodes[side].name = "Seq Scan on " + tables[side] + (aliases[side] != tables[side] ? " " + aliases[side] : "");
+		if (!side_terms[side].empty()) {
+			side_nodes[side].details.push_back("Filter: " + expr_to_string(make_conjunction(side_terms[side])));
+		}
+		if (stats[side]) {
+			side_nodes[side].estimated_rows = (double)stats[side]->row_count;
+			if (!side_terms[side].empty()) {
+				*side_nodes[side].estimated_rows *= estimate_selectivity(make_conjunction(side_terms[side]), column_stats);
+			}
+		}
+	}
+	if (stmt.order_by_column) {
+		sort_node.details.push_back("Sort Key: " + *stmt.order_by_column);
+		sort_node.details.push_back("Strategy: in-memory sort, numeric order for numbers");
+	}
+	if (stmt.limit) {
+		limit_node.details.push_back("Rows: " + std::to_string(*stmt.limit));
+	}
+
+	auto record_plan = [&]() {
+		join_node.children.push_back(std::move(side_nodes[build]));
+		join_node.children.push_back(std::move(side_nodes[probe]));
+
+		std::vector<PlanNode> operators;
+		if (stmt.limit) {
+			operators.push_back(std::move(limit_node));
+		}
+		if (stmt.order_by_column) {
+			operators.push_back(std::move(sort_node));
+		}
+		operators.push_back(std::move(join_node));
+		*plan = stack_plan(std::move(operators));
+	};
+
+	if (plan_only) {
+		record_plan();
+		return {};
+	}
+
+	auto start = PlanClock::now();
+	ScanCounters counters[2];
+	size_t side_rows[2] = { 0, 0 };
+	std::optional<std::function<bool(const std::vector<uint8_t>&)>> scan_filters[2] = {
+		countRecords(side_filters[0], counters[0]),
+		countRecords(side_filters[1], counters[1])
+	};
+
+	auto finish_side = [&](int side, PlanClock::time_point side_start) {
+		side_nodes[side].rows = side_rows[side];
+		side_nodes[side].pages = pages[side];
+		side_nodes[side].bytes = counters[side].bytes;
+		side_nodes[side].time_ms = elapsed_ms(side_start);
+
+		statement_stats.access_paths.push_back(join_node.name + ": " + side_nodes[side].name);
+		statement_stats.rows_scanned += counters[side].records;
+	};
+
+	std::vector<std::vector<std::string>> rows;
+	MemoryReservation memory(storage.memory(), "JOIN of " + tables[0] + " and " + tables[1]);
+
+	auto emit = [&](const std::vector<uint8_t>* left, const std::vector<uint8_t>* right) {
+		const std::vector<uint8_t>* raws[2] = { left, right };
+
+		if (post_filter && !post_filter->evaluate(raws)) {
+			return;
+		}
+		std::vector<std::string> row;
+		row.reserve(output.size());
+
+		for (auto& column : output) {
+			if (!raws[column.side]) {
+				row.push_back("NULL");
+			}
+			else {
+				row.push_back(value_to_string(read_column(schemas[column.side], *raws[column.side], column.index)));
+			}
+		}
+		memory.grow(row_bytes(row));
+		rows.push_back(std::move(row));
+	};
+
+	auto key_of = [&](int side, const std::vector<uint8_t>& raw) {
+		return read_column(schemas[side], raw, keys[side].index);
+	};
+
+	// build rows are kept in memory, probe rows are streamed; for a LEFT JOIN built on the
+	// left table the matched build rows are tracked to emit the unmatched ones at the end
+	auto join_partition = [&](const std::vector<std::vector<uint8_t>>& build_rows, const std::function<void(const RecordVisitor&)>& for_each_probe, MemoryReservation& build_memory) {
+		std::unordered_map<Value, std::vector<size_t>> hash_table;
+		for (size_t i = 0; i < build_rows.size(); i++) {
+			auto [entry, inserted] = hash_table.try_emplace(key_of(build, build_rows[i]));
+			build_memory.grow(sizeof(size_t) + (inserted ? 4 * sizeof(void*) + sizeof(std::vector<size_t>) + value_bytes(entry->first) : 0));
+			entry->second.push_back(i);
+		}
+
+		std::vector<bool> matched(build_rows.size(), false);
+
+		for_each_probe([&](const std::vector<uint8_t>& raw) {
+			auto it = hash_table.find(key_of(probe, raw));
+
+			if (it == hash_table.end()) {
+				if (left_join && probe == 0) {
+					emit(&raw, nullptr);
+				}
+				return;
+			}
+
+			for (size_t i : it->second) {
+				matched[i] = true;
+				if (build == 0) {
+					emit(&build_rows[i], &raw);
+				}
+				else {
+					emit(&raw, &build_rows[i]);
+				}
+			}
+		});
+
+		if (left_join && build == 0) {
+			for (size_t i = 0; i < build_rows.size(); i++) {
+				if (!matched[i]) {
+					emit(&build_rows[i], nullptr);
+				}
+			}
+		}
+	};
+
+	auto scan_side = [&](int side, const RecordVisitor& visit) {
+		storage.scan(
+			tables[side],
+			[&](int, const std::vector<uint8_t>& raw) {
+				side_rows[side]++;
+				visit(raw);
+				return false;
+			},
+			std::nullopt,
+			scan_filters[side]
+		);
+	};
+
+	if (!spill) {
+		MemoryReservation build_memory(storage.memory(), "JOIN build side " + tables[build]);
+		auto build_rows = storage.scan(tables[build], std::nullopt, std::nullopt, reserveRecords(scan_filters[build], build_memory));
+		side_rows[build] = build_rows.size();
+		finish_side(build, start);
+
+		// the probe side is streamed through the join, its time includes probing
+		auto probe_start = PlanClock::now();
+		join_partition(build_rows, [&](const RecordVisitor& visit) { scan_side(probe, visit); }, build_memory);
+		finish_side(probe, probe_start);
+	}
+	else {
+		// Grace hash join: both tables are split into partition files by the join key hash,
+		// then every partition pair is joined in memory
+		auto spill_dir = std::filesystem::temp_directory_path() /
+			("join_" + tables[0] + "_" + tables[1] + "_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+		std::filesystem::create_directories(spill_dir);
+
+		auto partition_path = [&](int side, int partition) {
+			return spill_dir / (std::to_string(side) + "_" + std::to_string(partition) + ".part");
+		};
+
+		auto read_partition = [&](int side, int partition, const RecordVisitor& visit) {
+			std::ifstream part(partition_path(side, partition), std::ios::binary);
+			uint32_t record_size;
+			while (part.read(reinterpret_cast<char*>(&record_size), sizeof(record_size))) {
+				std::vector<uint8_t> raw(record_size);
+				part.read(reinterpret_cast<char*>(raw.data()), record_size);
+				visit(raw);
+			}
+		};
+
+		try {
+			for (int side = 0; side < 2; side++) {
+				auto side_start = PlanClock::now();
+				std::vector<std::ofstream> parts;
+				for (int partition = 0; partition < JOIN_PARTITIONS; partition++) {
+					parts.emplace_back(partition_path(side, partition), std::ios::binary);
+				}
+
+				scan_side(side, [&](const std::vector<uint8_t>& raw) {
+					size_t partition = std::hash<Value>{}(key_of(side, raw)) % JOIN_PARTITIONS;
+					uint32_t record_size = raw.size();
+					parts[partition].write(reinterpret_cast<const char*>(&record_size), sizeof(record_size));
+					parts[partition].write(reinterpret_cast<const char*>(raw.data()), record_size);
+				});
+				finish_side(side, side_start);
+			}
+
+			for (int partition = 0; partition < JOIN_PARTITIONS; partition++) {
+				MemoryReservation build_memory(storage.memory(), "JOIN partition of " + tables[build]);
+				std::vector<std::vector<uint8_t>> build_rows;
+				read_partition(build, partition, [&](const std::vector<uint8_t>& raw) {
+					build_memory.grow(record_bytes(raw));
+					build_rows.push_back(raw);
+				});
+				join_partition(build_rows, [&](const RecordVisitor& visit) { read_partition(probe, partition, visit); }, build_memory);
+			}
+		}
+		catch (...) {
+			std::filesystem::remove_all(spill_dir);
+			throw;
+		}
+
+		std::filesystem::remove_all(spill_dir);
+	}
+	join_node.rows = rows.size();
+	join_node.time_ms = elapsed_ms(start);
+
+	if (stmt.order_by_column) {
+		TraceSpan span("sort", "sql");
+		auto it = std::find(stmt.columns.begin(), stmt.columns.end(), *stmt.order_by_column);
+		if (it != stmt.columns.end()) {
+			size_t col_index = std::distance(stmt.columns.begin(), it);
+			std::sort(rows.begin(), rows.end(),
+				[&](auto& a, auto& b) {return lessForOrder(a[col_index], b[col_index]); });
+		}
+	}
+	sort_node.rows = rows.size();
+	sort_node.time_ms = elapsed_ms(start);
+
+	if (stmt.limit && rows.size() > *stmt.limit) {
+		rows.resize(*stmt.limit);
+	}
+	limit_node.rows = rows.size();
+	limit_node.time_ms = elapsed_ms(start);
+
+	if (plan) {
+		record_plan();
+	}
+
+	statement_stats.rows_returned += rows.size();
+	return rows;
 }
 
-int QueryExecutor::executeCreateTableAs(const CTASStatement& stmt)
+std::vector<std::string> QueryExecutor::executeExplain(const ExplainStatement& stmt)
 {
-	auto rows = executeSelect(stmt.selectStmt);
+	PlanNode root;
+	plan = &root;
+	plan_only = !stmt.analyze;
 
-	auto schema = storage.get_table_schema(stmt.selectStmt.table_name);
-	if (schema.columns.empty()) {
-		throw std::runtime_error("Source table not found");
-	}
+	auto start = PlanClock::now();
+	try {
+		std::visit([&](auto& inner) {
+			using T = std::decay_t<decltype(inner)>;
 
-	if (!storage.create_table(stmt.table_name, schema)) {
-		throw std::runtime_error("Could not create table: " + stmt.table_name);
+			if constexpr (std::is_same_v<T, SelectStatement>) {
+				executeSelect(inner);
+			}
+			else if constexpr (std::is_same_v<T, DeleteStatement>) {
+				executeDelete(inner);
+			}
+			else {
+				executeUpdate(inner);
+			}
+		}, stmt.statement);
+	}
+	catch (...) {
+		plan = nullptr;
+		plan_only = false;
+		throw;
 	}
+	double total_ms = elapsed_ms(start);
+
+	plan = nullptr;
+	plan_only = false;
 
-	for (auto& row : rows) {
-		auto b = packRecord(schema, row);
-		storage.insert(stmt.table_name, b);
+	auto lines = format_plan(root, stmt.analyze);
+	if (stmt.analyze) {
+		std::ostringstream total;
+		total << "Execution Time: " << std::fixed << std::setprecision(3) << total_ms << " ms";
+		lines.push_back(total.str());
 	}
+	return lines;
+}
 
-	return (int)rows.size();
-};
+std::vector<std::string> QueryExecutor::executeAnalyze(const AnalyzeStatement& stmt)
+{
+	std::vector<std::string> tables = stmt.tables.empty() ? storage.list_tables() : stmt.tables;
+
+	for (auto& table : tables) {
+		if (!storage.analyze(table)) {
+			throw std::runtime_error("Could not analyze table " + table);
+		}
+	}
 
+	return tables;
+}
\ No newline at end of file
@@ -6,24 +6,110 @@
 #include "file_storage_layer.h"
 #include "table_schema.h"
 #include "ast.h"
+#include "record_codec.h"
+#include "query_plan.h"
 
+static const int PARALLEL_SCAN_MIN_PAGES = 64; // tables with at least this many pages are scanned by the worker pool
+static const int JOIN_SPILL_PAGES = 1024; // build side above this many pages is partitioned to disk
+static const int JOIN_PARTITIONS = 16; // number of spill partitions of a grace hash join
+
+// Running state of one aggregate function inside one group
+struct AggregateState {
+	int64_t count = 0;
+	int64_t sum = 0;
+	std::optional<Value> min;
+	std::optional<Value> max;
+};
+
+// How the records of one table are read
+struct AccessPath {
+	enum class Method { Seq, Parallel, Index };
+
+	Method method = Method::Seq;
+	std::string index_key; // first column value looked up in the hash index
+	std::vector<int> index_rids; // records of the key's index bucket
+	std::optional<double> estimated_rows; // rows matching the WHERE, when the table was analyzed
+};
+
+// What the statements of one executor read and returned, for the slow query log
+struct StatementStats {
+	std::vector<std::string> access_paths; // scan operators, e.g. "Index Lookup on t"
+	uint64_t rows_scanned = 0; // records given to the WHERE filter (counted while EXPLAIN ANALYZE or the slow log runs)
+	uint64_t rows_returned = 0; // result rows, or inserted, updated and deleted rows
+};
 
 class QueryExecutor
 {
 	FileStorageLayer& storage;
+	StatementStats statement_stats;
 
-	std::vector<uint8_t> packRecord(const TableSchema& schema, const std::vector<std::string>& values);
-	std::vector<std::string> unpackRecord(const TableSchema& schema, const std::vector<uint8_t>& values);
+	PlanNode* plan = nullptr; // EXPLAIN records the operators of the running statement here
+	bool plan_only = false; // EXPLAIN without ANALYZE stops before any record is read
+
+	std::optional<std::function<bool(const std::vector<uint8_t>&)>> makeWhereFilter(
+		const std::string& table,
+		const TableSchema& schema,
+		const std::optional<Expr>& where);
+
+	// Index lookup when the WHERE fixes the first column and its bucket is smaller than the table,
+	// otherwise a (parallel) scan of all pages
+	AccessPath chooseAccessPath(
+		const std::string& table,
+		const TableSchema& schema,
+		const std::optional<Expr>& where,
+		bool allow_parallel);
+
+	// Records of the access path's index bucket that pass the filter
+	std::vector<std::pair<int, std::vector<uint8_t>>> indexLookup(
+		const std::string& table,
+		const AccessPath& path,
+		const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func);
+
+	PlanNode scanNode(const std::string& table, const AccessPath& path, const std::optional<Expr>& where);
+
+	// Fills in the measured values of a finished scan
+	void finishScan(PlanNode& node, const std::string& table, const AccessPath& path, const ScanCounters& counters, size_t rows, PlanClock::time_point start);
+
+	// The filter counting what it is given while EXPLAIN ANALYZE runs, the filter itself otherwise
+	std::optional<std::function<bool(const std::vector<uint8_t>&)>> countRecords(
+		const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func,
+		ScanCounters& counters);
+
+	// The filter reserving the memory of every record it lets through, so scans that collect
+	// records stop as soon as the memory limit is reached
+	std::optional<std::function<bool(const std::vector<uint8_t>&)>> reserveRecords(
+		const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func,
+		MemoryReservation& reservation);
+
+	std::vector<std::vector<std::string>> executeAggregate(
+		const SelectStatement& selectStmt,
+		const TableSchema& schema,
+		const std::optional<std::function<bool(const std::vector<uint8_t>&)>>& filter_func);
+
+	std::vector<std::vector<std::string>> executeJoin(const SelectStatement& selectStmt);
 
 public:
 	QueryExecutor(FileStorageLayer& s);
 
-	int executeInsert(const InsertStatement& insertStmt);
+	std::vector<uint8_t> packRecord(const TableSchema& schema, const std::vector<std::string>& values);
+	std::vector<std::string> unpackRecord(const TableSchema& schema, const std::vector<uint8_t>& values);
+
+	std::vector<int> executeInsert(const InsertStatement& insertStmt);
 
 	std::vector<std::vector<std::string>> executeSelect(const SelectStatement& selectStmt);
 
 	size_t executeDelete(const DeleteStatement& deleteStmt);
 
+	size_t executeUpdate(const UpdateStatement& updateStmt);
+
 	int executeCreateTableAs(const CTASStatement& ctasStmt);
+
+	// Refresh the statistics of the listed tables (all tables if empty), returns the analyzed tables
+	std::vector<std::string> executeAnalyze(const AnalyzeStatement& analyzeStmt);
+
+	// Operator tree of the statement; with ANALYZE the statement is executed (and its changes kept)
+	std::vector<std::string> executeExplain(const ExplainStatement& explainStmt);
+
+	const StatementStats& statementStats() const;
 };
 
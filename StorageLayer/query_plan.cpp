@@ -0,0 +1,50 @@
+#include "query_plan.h"
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+PlanNode stack_plan(std::vector<PlanNode> operators) {
+	PlanNode node = std::move(operators.back());
+
+	for (size_t i = operators.size() - 1; i-- > 0;) {
+		PlanNode parent = std::move(operators[i]);
+		parent.children.insert(parent.children.begin(), std::move(node));
+		node = std::move(parent);
+	}
+	return node;
+}
+
+static void format_node(const PlanNode& node, bool analyze, size_t depth, std::vector<std::string>& lines) {
+	// children start under the details of their parent, marked with an arrow
+	std::string indent(depth == 0 ? 0 : 2 + (depth - 1) * 6, ' ');
+	std::ostringstream line;
+	line << indent << (depth > 0 ? "->  " : "") << node.name;
+
+	if (node.estimated_rows) {
+		line << "  (estimated rows=" << std::llround(*node.estimated_rows) << ")";
+	}
+	if (analyze) {
+		line << "  (actual rows=" << node.rows << " pages=" << node.pages << " bytes=" << node.bytes
+			<< " time=" << std::fixed << std::setprecision(3) << node.time_ms << " ms)";
+	}
+	lines.push_back(line.str());
+
+	std::string detail_indent(indent.size() + (depth > 0 ? 6 : 2), ' ');
+	for (auto& detail : node.details) {
+		lines.push_back(detail_indent + detail);
+	}
+
+	for (auto& child : node.children) {
+		format_node(child, analyze, depth + 1, lines);
+	}
+}
+
+std::vector<std::string> format_plan(const PlanNode& root, bool analyze) {
+	std::vector<std::string> lines;
+	format_node(root, analyze, 0, lines);
+	return lines;
+}
+
+double elapsed_ms(PlanClock::time_point start) {
+	return std::chrono::duration<double, std::milli>(PlanClock::now() - start).count();
+}
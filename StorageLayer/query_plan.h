@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+using PlanClock = std::chrono::steady_clock;
+
+/**
+ * One operator of a statement as shown by EXPLAIN. The executor records the operators it chose
+ * while planning, EXPLAIN ANALYZE also fills in what was measured while the statement ran.
+ */
+struct PlanNode {
+	PlanNode() = default;
+	explicit PlanNode(std::string name) : name(std::move(name)) {}
+
+	std::string name; // e.g. "Seq Scan on emp", "Hash Join", "Sort"
+	std::vector<std::string> details; // filters, keys and strategies of the operator
+	std::optional<double> estimated_rows; // from table statistics, missing when not analyzed
+
+	// measured by EXPLAIN ANALYZE, time includes the operators below
+	uint64_t rows = 0;
+	uint64_t pages = 0;
+	uint64_t bytes = 0;
+	double time_ms = 0;
+
+	std::vector<PlanNode> children;
+};
+
+// Records and bytes a scan passed to its filter, updated by all scan workers
+struct ScanCounters {
+	std::atomic<uint64_t> records{ 0 };
+	std::atomic<uint64_t> bytes{ 0 };
+};
+
+// The operators nest top down: every operator becomes the input of the one before it
+PlanNode stack_plan(std::vector<PlanNode> operators);
+
+// Indented operator tree, with the measured values when analyze is set
+std::vector<std::string> format_plan(const PlanNode& root, bool analyze);
+
+double elapsed_ms(PlanClock::time_point start);
@@ -0,0 +1,141 @@
+#include "record_codec.h"
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+size_t ValueVectorHash::operator()(const std::vector<Value>& values) const {
+	size_t seed = values.size();
+	for (auto& value : values) {
+		size_t h = std::hash<Value>{}(value);
+		seed ^= h + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	}
+	return seed;
+}
+
+std::vector<size_t> column_offsets(const TableSchema& schema, const std::vector<uint8_t>& record) {
+	std::vector<size_t> offsets;
+	offsets.reserve(schema.columns.size());
+	size_t offset = 0;
+
+	for (auto& column : schema.columns) {
+		offsets.push_back(offset);
+
+		if (column.type == DataType::INT) {
+			offset += sizeof(int);
+		}
+		else {
+			if (offset + sizeof(uint16_t) > record.size()) {
+				throw std::runtime_error("Invalid record size for STRING column");
+			}
+			uint16_t strLength;
+			std::memcpy(&strLength, record.data() + offset, sizeof(uint16_t));
+			offset += sizeof(uint16_t) + strLength;
+		}
+	}
+
+	return offsets;
+}
+
+Value read_value(const Column& column, const std::vector<uint8_t>& record, size_t offset) {
+	if (column.type == DataType::INT) {
+		if (offset + sizeof(int) > record.size()) {
+			throw std::runtime_error("Invalid record size for INT column");
+		}
+		int val;
+		std::memcpy(&val, record.data() + offset, sizeof(int));
+		return val;
+	}
+
+	if (offset + sizeof(uint16_t) > record.size()) {
+		throw std::runtime_error("Invalid record size for STRING column");
+	}
+	uint16_t strLength;
+	std::memcpy(&strLength, record.data() + offset, sizeof(uint16_t));
+	offset += sizeof(uint16_t);
+
+	if (offset + strLength > record.size()) {
+		throw std::runtime_error("Invalid record size for STRING column");
+	}
+	return std::string((const char*)record.data() + offset, strLength);
+}
+
+Value read_column(const TableSchema& schema, const std::vector<uint8_t>& record, int index) {
+	size_t offset = 0;
+
+	for (int i = 0; i < index; i++) {
+		if (schema.columns[i].type == DataType::INT) {
+			offset += sizeof(int);
+		}
+		else {
+			if (offset + sizeof(uint16_t) > record.size()) {
+				throw std::runtime_error("Invalid record size for STRING column");
+			}
+			uint16_t strLength;
+			std::memcpy(&strLength, record.data() + offset, sizeof(uint16_t));
+			offset += sizeof(uint16_t) + strLength;
+		}
+	}
+
+	return read_value(schema.columns[index], record, offset);
+}
+
+std::vector<uint8_t> project_record(const TableSchema& schema, const std::vector<uint8_t>& record, const std::vector<int>& indexes) {
+	auto offsets = column_offsets(schema, record);
+	std::vector<uint8_t> projected;
+
+	for (int index : indexes) {
+		size_t begin = offsets[index];
+		size_t end = index + 1 < (int)offsets.size() ? offsets[index + 1] : record.size();
+
+		if (schema.columns[index].type == DataType::INT) {
+			end = begin + sizeof(int);
+		}
+		if (end > record.size()) {
+			throw std::runtime_error("Invalid record size for projection");
+		}
+
+		projected.insert(projected.end(), record.begin() + begin, record.begin() + end);
+	}
+
+	return projected;
+}
+
+void write_value(const Column& column, const Value& value, std::vector<uint8_t>& record) {
+	if (column.type == DataType::INT) {
+		int val = std::holds_alternative<int>(value) ? std::get<int>(value) : std::stoi(std::get<std::string>(value));
+		uint8_t buffer[sizeof(int)];
+		std::memcpy(buffer, &val, sizeof(int));
+		record.insert(record.end(), buffer, buffer + sizeof(int));
+	}
+	else {
+		std::string str = value_to_string(value);
+		uint16_t strLength = (uint16_t)std::min((size_t)column.length, str.size());
+		uint8_t lengthBuffer[sizeof(uint16_t)];
+		std::memcpy(lengthBuffer, &strLength, sizeof(uint16_t));
+		record.insert(record.end(), lengthBuffer, lengthBuffer + sizeof(uint16_t));
+		record.insert(record.end(), str.begin(), str.begin() + strLength);
+	}
+}
+
+Value parse_value(const Column& column, const std::string& literal) {
+	if (column.type == DataType::INT) {
+		return std::stoi(literal);
+	}
+	return literal;
+}
+
+std::string value_to_string(const Value& value) {
+	if (std::holds_alternative<int>(value)) {
+		return std::to_string(std::get<int>(value));
+	}
+	return std::get<std::string>(value);
+}
+
+int find_column(const TableSchema& schema, const std::string& name) {
+	for (int i = 0; i < (int)schema.columns.size(); i++) {
+		if (schema.columns[i].name == name) {
+			return i;
+		}
+	}
+	return -1;
+}
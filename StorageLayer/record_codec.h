@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <variant>
+#include <cstdint>
+#include <functional>
+#include "table_schema.h"
+
+// Typed value of a single column, decoded straight from packed record bytes
+using Value = std::variant<int, std::string>;
+
+struct ValueVectorHash {
+	size_t operator()(const std::vector<Value>& values) const;
+};
+
+// Byte offset of every column inside a packed record (INT = 4 bytes, VARCHAR = uint16 length + data)
+std::vector<size_t> column_offsets(const TableSchema& schema, const std::vector<uint8_t>& record);
+
+// Decode one column starting at the given byte offset
+Value read_value(const Column& column, const std::vector<uint8_t>& record, size_t offset);
+
+// Decode one column by index, walking the preceding columns
+Value read_column(const TableSchema& schema, const std::vector<uint8_t>& record, int index);
+
+// Copy the packed bytes of the selected columns into a new record, without decoding the values
+std::vector<uint8_t> project_record(const TableSchema& schema, const std::vector<uint8_t>& record, const std::vector<int>& indexes);
+
+// Append the packed form of a value to the record
+void write_value(const Column& column, const Value& value, std::vector<uint8_t>& record);
+
+// Convert a SQL literal into a typed value for the given column
+Value parse_value(const Column& column, const std::string& literal);
+
+std::string value_to_string(const Value& value);
+
+// Index of the column with the given name or -1
+int find_column(const TableSchema& schema, const std::string& name);
@@ -0,0 +1,105 @@
+#include "slow_query_log.h"
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+static std::string json_string(const std::string& text) {
+	std::string escaped = "\"";
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		}
+		else if ((unsigned char)c < 0x20) {
+			escaped += ' ';
+		}
+		else {
+			escaped += c;
+		}
+	}
+	return escaped + "\"";
+}
+
+static std::string utc_timestamp() {
+	std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	std::tm utc{};
+#ifdef _WIN32
+	gmtime_s(&utc, &now);
+#else
+	gmtime_r(&now, &utc);
+#endif
+	std::ostringstream text;
+	text << std::put_time(&utc, "%Y-%m-%dT%H:%M:%SZ");
+	return text.str();
+}
+
+bool SlowQueryLog::open(const std::string& path, double threshold_ms) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (file.is_open()) {
+		file.close();
+	}
+	file.open(path, std::ios::app);
+
+	threshold.store(threshold_ms, std::memory_order_relaxed);
+	active.store(file.is_open(), std::memory_order_relaxed);
+	return file.is_open();
+}
+
+void SlowQueryLog::close() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	active.store(false, std::memory_order_relaxed);
+	if (file.is_open()) {
+		file.close();
+	}
+}
+
+double SlowQueryLog::threshold_ms() const {
+	return threshold.load(std::memory_order_relaxed);
+}
+
+void SlowQueryLog::write(const SlowQueryEntry& entry) {
+	std::ostringstream line;
+	line << std::fixed << std::setprecision(3);
+	line << "{\"time\": " << json_string(utc_timestamp()) << ", \"kind\": " << json_string(entry.kind);
+
+	if (!entry.table.empty()) {
+		line << ", \"table\": " << json_string(entry.table);
+	}
+	if (!entry.statement.empty()) {
+		line << ", \"statement\": " << json_string(entry.statement);
+	}
+	line << ", \"duration_ms\": " << entry.duration_ms;
+
+	if (!entry.access_paths.empty()) {
+		line << ", \"access_paths\": [";
+		for (size_t i = 0; i < entry.access_paths.size(); i++) {
+			line << (i > 0 ? ", " : "") << json_string(entry.access_paths[i]);
+		}
+		line << "]";
+	}
+	if (entry.rows_scanned) {
+		line << ", \"rows_scanned\": " << *entry.rows_scanned;
+	}
+	if (entry.rows_returned) {
+		line << ", \"rows_returned\": " << *entry.rows_returned;
+	}
+
+	line << ", \"io\": {";
+	for (auto& [name, value] : entry.io.entries()) {
+		// call counters of the nested storage operations are left out, the I/O is what matters here
+		if (value == 0 || name.find("_calls") != std::string::npos) {
+			continue;
+		}
+		line << "\"" << name << "\": " << value << ", ";
+	}
+	line << "\"syscalls\": " << entry.io.syscalls() << "}}\n";
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (file.is_open()) {
+		file << line.str();
+		file.flush();
+	}
+}
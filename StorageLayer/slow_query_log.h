@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include "storage_counters.h"
+
+// One statement or storage call that took longer than the threshold
+struct SlowQueryEntry {
+	std::string kind; // "sql" or the storage operation, e.g. "update"
+	std::string table;
+	std::string statement; // SQL text
+	double duration_ms = 0;
+	std::vector<std::string> access_paths; // scans of the statement, e.g. "Index Lookup on t"
+	std::optional<uint64_t> rows_scanned;
+	std::optional<uint64_t> rows_returned;
+	StorageStats io; // storage counters during the call, other threads' I/O included
+};
+
+/**
+ * Appends every entry slower than the threshold to a file, one JSON object per line.
+ * The log is off until open() is called, checking it is then a single atomic load.
+ */
+class SlowQueryLog {
+public:
+	bool open(const std::string& path, double threshold_ms);
+	void close();
+
+	bool enabled() const {
+		return active.load(std::memory_order_relaxed);
+	}
+
+	double threshold_ms() const;
+
+	// True if the duration is logged, callers skip building the entry otherwise
+	bool is_slow(double duration_ms) const {
+		return enabled() && duration_ms >= threshold_ms();
+	}
+
+	void write(const SlowQueryEntry& entry);
+
+private:
+	std::atomic<bool> active{ false };
+	std::atomic<double> threshold{ 0 };
+	std::mutex mutex;
+	std::ofstream file;
+};
@@ -0,0 +1,73 @@
+#include "storage_counters.h"
+
+const char* counter_name(StorageCounter counter) {
+	switch (counter) {
+	case StorageCounter::PagesRead: return "pages_read";
+	case StorageCounter::PagesWritten: return "pages_written";
+	case StorageCounter::BytesRead: return "bytes_read";
+	case StorageCounter::BytesWritten: return "bytes_written";
+	case StorageCounter::ReadCalls: return "read_calls";
+	case StorageCounter::WriteCalls: return "write_calls";
+	case StorageCounter::FileOpens: return "file_opens";
+	case StorageCounter::Flushes: return "flushes";
+	case StorageCounter::Fsyncs: return "fsyncs";
+	case StorageCounter::VacuumRuns: return "vacuum_runs";
+	case StorageCounter::PagesVacuumed: return "pages_vacuumed";
+	case StorageCounter::WriteBacks: return "write_backs";
+	case StorageCounter::IndexLoads: return "index_loads";
+	case StorageCounter::IndexSaves: return "index_saves";
+	case StorageCounter::InsertCalls: return "insert_calls";
+	case StorageCounter::InsertManyCalls: return "insert_many_calls";
+	case StorageCounter::GetCalls: return "get_calls";
+	case StorageCounter::UpdateCalls: return "update_calls";
+	case StorageCounter::UpdateWhereCalls: return "update_where_calls";
+	case StorageCounter::DeleteCalls: return "delete_calls";
+	case StorageCounter::DeleteManyCalls: return "delete_many_calls";
+	case StorageCounter::ScanCalls: return "scan_calls";
+	case StorageCounter::ParallelScanCalls: return "parallel_scan_calls";
+	case StorageCounter::FindCalls: return "find_calls";
+	case StorageCounter::AnalyzeCalls: return "analyze_calls";
+	case StorageCounter::BulkLoads: return "bulk_loads";
+	case StorageCounter::Count: break;
+	}
+	return "unknown";
+}
+
+uint64_t StorageStats::operator[](StorageCounter counter) const {
+	return values[static_cast<size_t>(counter)];
+}
+
+uint64_t StorageStats::syscalls() const {
+	return (*this)[StorageCounter::ReadCalls] + (*this)[StorageCounter::WriteCalls] + (*this)[StorageCounter::FileOpens]
+		+ (*this)[StorageCounter::Flushes] + (*this)[StorageCounter::Fsyncs];
+}
+
+StorageStats StorageStats::since(const StorageStats& earlier) const {
+	StorageStats delta;
+	for (size_t i = 0; i < STORAGE_COUNTER_COUNT; i++) {
+		delta.values[i] = values[i] - earlier.values[i];
+	}
+	return delta;
+}
+
+std::vector<std::pair<std::string, uint64_t>> StorageStats::entries() const {
+	std::vector<std::pair<std::string, uint64_t>> result;
+	for (size_t i = 0; i < STORAGE_COUNTER_COUNT; i++) {
+		result.emplace_back(counter_name(static_cast<StorageCounter>(i)), values[i]);
+	}
+	return result;
+}
+
+StorageStats StorageCounters::snapshot() const {
+	StorageStats stats;
+	for (size_t i = 0; i < STORAGE_COUNTER_COUNT; i++) {
+		stats.values[i] = values[i].load(std::memory_order_relaxed);
+	}
+	return stats;
+}
+
+void StorageCounters::reset() {
+	for (auto& value : values) {
+		value.store(0, std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Everything the storage layer counts, calls made by the layer itself (vacuum scanning the table) are included
+enum class StorageCounter {
+	PagesRead,
+	PagesWritten,
+	BytesRead, // table pages and index files
+	BytesWritten,
+	ReadCalls, // stream reads and writes, each one may reach the OS as a syscall
+	WriteCalls,
+	FileOpens,
+	Flushes,
+	Fsyncs,
+	VacuumRuns, // passes of the vacuum worker that compacted pages
+	PagesVacuumed,
+	WriteBacks, // write-backs of dirty pages, by the page writer or a Sync write call
+	IndexLoads,
+	IndexSaves,
+
+	InsertCalls,
+	InsertManyCalls,
+	GetCalls,
+	UpdateCalls,
+	UpdateWhereCalls,
+	DeleteCalls,
+	DeleteManyCalls,
+	ScanCalls,
+	ParallelScanCalls,
+	FindCalls,
+	AnalyzeCalls,
+	BulkLoads,
+
+	Count
+};
+
+static const size_t STORAGE_COUNTER_COUNT = static_cast<size_t>(StorageCounter::Count);
+
+// snake_case name used by the stats command and the benchmark output
+const char* counter_name(StorageCounter counter);
+
+// Copy of the counters at one point in time
+struct StorageStats {
+	std::array<uint64_t, STORAGE_COUNTER_COUNT> values{};
+
+	uint64_t operator[](StorageCounter counter) const;
+
+	// Stream calls that may reach the OS: reads, writes, opens, flushes and fsyncs
+	uint64_t syscalls() const;
+
+	// Counts between an earlier snapshot and this one
+	StorageStats since(const StorageStats& earlier) const;
+
+	// name and value of every counter, in enum order
+	std::vector<std::pair<std::string, uint64_t>> entries() const;
+};
+
+// Counters updated from the caller and from the scan workers, relaxed atomics are enough for totals
+class StorageCounters {
+public:
+	void add(StorageCounter counter, uint64_t amount = 1) {
+		values[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+	}
+
+	StorageStats snapshot() const;
+	void reset();
+
+private:
+	std::array<std::atomic<uint64_t>, STORAGE_COUNTER_COUNT> values{};
+};
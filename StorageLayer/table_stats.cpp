@@ -0,0 +1,275 @@
+#include "table_stats.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <bit>
+
+// Spread the bits of std::hash, which is the identity for integers
+static uint64_t mix_hash(uint64_t hash) {
+	hash ^= hash >> 30;
+	hash *= 0xbf58476d1ce4e5b9ull;
+	hash ^= hash >> 27;
+	hash *= 0x94d049bb133111ebull;
+	hash ^= hash >> 31;
+	return hash;
+}
+
+HyperLogLog::HyperLogLog() : registers(1 << HLL_PRECISION, 0) {}
+
+void HyperLogLog::add(const Value& value) {
+	uint64_t hash = mix_hash(std::hash<Value>{}(value));
+	size_t index = hash >> (64 - HLL_PRECISION);
+	uint64_t rest = hash << HLL_PRECISION;
+
+	uint8_t rank = rest == 0 ? 64 - HLL_PRECISION + 1 : std::countl_zero(rest) + 1;
+	registers[index] = std::max(registers[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+	for (size_t i = 0; i < registers.size(); i++) {
+		registers[i] = std::max(registers[i], other.registers[i]);
+	}
+}
+
+double HyperLogLog::estimate() const {
+	double m = registers.size();
+	double sum = 0;
+	size_t zeros = 0;
+
+	for (uint8_t rank : registers) {
+		sum += std::ldexp(1.0, -rank);
+		if (rank == 0) {
+			zeros++;
+		}
+	}
+
+	double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+
+	// small cardinalities are counted by the empty registers (linear counting)
+	if (estimate <= 2.5 * m && zeros > 0) {
+		estimate = m * std::log(m / zeros);
+	}
+	return estimate;
+}
+
+std::string HyperLogLog::to_hex() const {
+	static const char digits[] = "0123456789abcdef";
+	std::string hex;
+	hex.reserve(registers.size() * 2);
+
+	for (uint8_t rank : registers) {
+		hex += digits[rank >> 4];
+		hex += digits[rank & 0xF];
+	}
+	return hex;
+}
+
+HyperLogLog HyperLogLog::from_hex(const std::string& hex) {
+	HyperLogLog sketch;
+
+	for (size_t i = 0; i < sketch.registers.size() && 2 * i + 1 < hex.size(); i++) {
+		sketch.registers[i] = (uint8_t)std::stoi(hex.substr(2 * i, 2), nullptr, 16);
+	}
+	return sketch;
+}
+
+double ColumnStats::distinct_values() const {
+	return std::max({ distinct, sketch.estimate(), 1.0 });
+}
+
+TableStats build_table_stats(const TableSchema& schema, const std::vector<std::vector<uint8_t>>& sample, size_t sampled_pages, size_t page_count) {
+	TableStats stats;
+	stats.page_count = page_count;
+	stats.sampled_pages = sampled_pages;
+	stats.row_count = sampled_pages == 0 ? 0 : (uint64_t)std::llround((double)sample.size() * page_count / sampled_pages);
+
+	std::vector<std::vector<Value>> values(schema.columns.size());
+	for (auto& column_values : values) {
+		column_values.reserve(sample.size());
+	}
+
+	for (auto& record : sample) {
+		auto offsets = column_offsets(schema, record);
+		for (size_t i = 0; i < schema.columns.size(); i++) {
+			values[i].push_back(read_value(schema.columns[i], record, offsets[i]));
+		}
+	}
+
+	for (size_t i = 0; i < schema.columns.size(); i++) {
+		ColumnStats column;
+		column.type = schema.columns[i].type;
+
+		auto& column_values = values[i];
+		std::sort(column_values.begin(), column_values.end());
+
+		for (auto& value : column_values) {
+			column.sketch.add(value);
+		}
+
+		if (!column_values.empty()) {
+			column.min = column_values.front();
+			column.max = column_values.back();
+
+			for (int bucket = 0; bucket <= STATS_HISTOGRAM_BUCKETS; bucket++) {
+				column.histogram.push_back(column_values[bucket * (column_values.size() - 1) / STATS_HISTOGRAM_BUCKETS]);
+			}
+		}
+
+		// a column that is (almost) unique in the sample is assumed to be unique in the table
+		double sample_distinct = column.sketch.estimate();
+		column.distinct = sample_distinct;
+		if (sampled_pages < page_count && sample_distinct >= 0.9 * column_values.size()) {
+			column.distinct = std::min((double)stats.row_count, sample_distinct * page_count / sampled_pages);
+		}
+
+		stats.columns.push_back(std::move(column));
+	}
+
+	return stats;
+}
+
+void update_table_stats(TableStats& stats, const TableSchema& schema, const std::vector<uint8_t>& record) {
+	auto offsets = column_offsets(schema, record);
+
+	for (size_t i = 0; i < stats.columns.size() && i < schema.columns.size(); i++) {
+		ColumnStats& column = stats.columns[i];
+		Value value = read_value(schema.columns[i], record, offsets[i]);
+
+		if (!column.min || value < *column.min) {
+			column.min = value;
+		}
+		if (!column.max || *column.max < value) {
+			column.max = value;
+		}
+		column.sketch.add(value);
+	}
+}
+
+// Values are written as "i <int>", "s <length> <bytes>" or "-" when missing
+static void write_stats_value(std::ostream& out, const std::optional<Value>& value) {
+	if (!value) {
+		out << "-";
+	}
+	else if (std::holds_alternative<int>(*value)) {
+		out << "i " << std::get<int>(*value);
+	}
+	else {
+		auto& text = std::get<std::string>(*value);
+		out << "s " << text.size() << " " << text;
+	}
+}
+
+static std::optional<Value> read_stats_value(std::istream& in) {
+	std::string tag;
+	in >> tag;
+
+	if (tag == "i") {
+		int value;
+		in >> value;
+		return value;
+	}
+
+	if (tag == "s") {
+		size_t length;
+		in >> length;
+		in.get();
+
+		std::string text(length, '\0');
+		in.read(text.data(), length);
+		return text;
+	}
+	return std::nullopt;
+}
+
+bool save_table_stats(const std::string& path, const TableStats& stats) {
+	std::ofstream file(path, std::ios::trunc | std::ios::binary);
+
+	if (!file.is_open()) {
+		return false;
+	}
+
+	file << stats.row_count << " " << stats.page_count << " " << stats.sampled_pages << " " << stats.modified_rows << "\n";
+	file << stats.columns.size() << "\n";
+
+	for (auto& column : stats.columns) {
+		file << static_cast<int>(column.type) << " " << column.distinct << " " << column.sketch.to_hex() << "\n";
+		write_stats_value(file, column.min);
+		file << "\n";
+		write_stats_value(file, column.max);
+		file << "\n";
+
+		file << column.histogram.size() << "\n";
+		for (auto& bound : column.histogram) {
+			write_stats_value(file, bound);
+			file << "\n";
+		}
+	}
+
+	return (bool)file;
+}
+
+std::optional<TableStats> load_table_stats(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+
+	if (!file.is_open()) {
+		return std::nullopt;
+	}
+
+	TableStats stats;
+	size_t column_count = 0;
+	file >> stats.row_count >> stats.page_count >> stats.sampled_pages >> stats.modified_rows >> column_count;
+
+	for (size_t i = 0; i < column_count && file; i++) {
+		ColumnStats column;
+		int type;
+		std::string sketch;
+		file >> type >> column.distinct >> sketch;
+
+		column.type = static_cast<DataType>(type);
+		column.sketch = HyperLogLog::from_hex(sketch);
+		column.min = read_stats_value(file);
+		column.max = read_stats_value(file);
+
+		size_t bounds = 0;
+		file >> bounds;
+		for (size_t b = 0; b < bounds && file; b++) {
+			auto bound = read_stats_value(file);
+			if (bound) {
+				column.histogram.push_back(*bound);
+			}
+		}
+
+		stats.columns.push_back(std::move(column));
+	}
+
+	if (!file) {
+		return std::nullopt; // truncated or corrupt, the table is treated as not analyzed
+	}
+	return stats;
+}
+
+double fraction_below(const ColumnStats& stats, const Value& value) {
+	auto& bounds = stats.histogram;
+
+	if (bounds.size() < 2) {
+		return 0.5;
+	}
+	if (!(bounds.front() < value)) {
+		return 0.0;
+	}
+	if (!(value < bounds.back())) {
+		return 1.0;
+	}
+
+	size_t bucket = std::upper_bound(bounds.begin(), bounds.end(), value) - bounds.begin() - 1;
+	const Value& low = bounds[bucket];
+	const Value& high = bounds[bucket + 1];
+
+	// numbers are interpolated inside the bucket, strings are assumed to be in the middle
+	double within = 0.5;
+	if (std::holds_alternative<int>(value) && std::get<int>(high) > std::get<int>(low)) {
+		within = (double)(std::get<int>(value) - std::get<int>(low)) / ((double)std::get<int>(high) - std::get<int>(low));
+	}
+
+	return (bucket + within) / (bounds.size() - 1);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include "table_schema.h"
+#include "record_codec.h"
+
+static const int STATS_SAMPLE_PAGES = 256; // pages read by ANALYZE, larger tables are sampled evenly
+static const int STATS_HISTOGRAM_BUCKETS = 16; // buckets of the equi-depth histogram of every column
+static const int HLL_PRECISION = 10; // 2^10 HyperLogLog registers, about 3% error
+
+// Distinct value counter using a fixed amount of memory, counters can be merged
+class HyperLogLog {
+public:
+	HyperLogLog();
+
+	void add(const Value& value);
+	void merge(const HyperLogLog& other);
+	double estimate() const;
+
+	std::string to_hex() const;
+	static HyperLogLog from_hex(const std::string& hex);
+
+private:
+	std::vector<uint8_t> registers;
+};
+
+struct ColumnStats {
+	DataType type = DataType::INT;
+	std::optional<Value> min;
+	std::optional<Value> max;
+	HyperLogLog sketch; // values seen by ANALYZE and by later writes
+	double distinct = 0; // distinct values in the table, scaled up from the sample
+	std::vector<Value> histogram; // bucket bounds, every bucket holds about the same number of rows
+
+	double distinct_values() const;
+};
+
+struct TableStats {
+	uint64_t row_count = 0;
+	uint64_t page_count = 0; // pages when ANALYZE ran
+	uint64_t sampled_pages = 0;
+	uint64_t modified_rows = 0; // rows written or deleted since ANALYZE
+	std::vector<ColumnStats> columns;
+};
+
+// Statistics from the records of sampled_pages whole pages out of page_count pages
+TableStats build_table_stats(const TableSchema& schema, const std::vector<std::vector<uint8_t>>& sample, size_t sampled_pages, size_t page_count);
+
+// Fold a written record into min/max and the distinct counters, the row count is adjusted by the caller
+void update_table_stats(TableStats& stats, const TableSchema& schema, const std::vector<uint8_t>& record);
+
+bool save_table_stats(const std::string& path, const TableStats& stats);
+std::optional<TableStats> load_table_stats(const std::string& path);
+
+// Fraction of rows with a value below the given one, taken from the histogram
+double fraction_below(const ColumnStats& stats, const Value& value);
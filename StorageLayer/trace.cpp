@@ -0,0 +1,107 @@
+#include "trace.h"
+#include <fstream>
+#include <iomanip>
+
+static std::string json_string(const std::string& text) {
+	std::string escaped = "\"";
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		}
+		else if ((unsigned char)c < 0x20) {
+			escaped += ' ';
+		}
+		else {
+			escaped += c;
+		}
+	}
+	return escaped + "\"";
+}
+
+Tracer& Tracer::instance() {
+	static Tracer tracer;
+	return tracer;
+}
+
+uint32_t Tracer::thread_number() {
+	// small stable numbers instead of the opaque thread ids, the viewer shows one row per thread
+	static std::atomic<uint32_t> next{ 1 };
+	thread_local uint32_t number = next.fetch_add(1);
+	return number;
+}
+
+bool Tracer::start(const std::string& path) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (active.load()) {
+		return false;
+	}
+
+	events.clear();
+	dropped = 0;
+	output_path = path;
+	origin = TraceClock::now();
+	active.store(true);
+	return true;
+}
+
+bool Tracer::stop() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!active.load()) {
+		return false;
+	}
+	active.store(false);
+
+	std::ofstream out(output_path, std::ios::trunc);
+	if (!out.is_open()) {
+		return false;
+	}
+
+	out << std::fixed << std::setprecision(3);
+	out << "{\"traceEvents\": [\n";
+	for (size_t i = 0; i < events.size(); i++) {
+		const Event& event = events[i];
+		out << "  {\"name\": \"" << event.name << "\", \"cat\": \"" << event.category << "\", \"ph\": \"X\""
+			<< ", \"ts\": " << event.ts_us << ", \"dur\": " << event.dur_us
+			<< ", \"pid\": 1, \"tid\": " << event.tid
+			<< ", \"args\": {" << event.args << "}}"
+			<< (i + 1 < events.size() ? "," : "") << "\n";
+	}
+	out << "], \"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": " << dropped << "}}\n";
+
+	events.clear();
+	events.shrink_to_fit();
+	return (bool)out;
+}
+
+void Tracer::add(const char* name, const char* category, TraceClock::time_point begin, TraceClock::time_point end, const std::string& args) {
+	uint32_t tid = thread_number();
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// a span still open when the trace was stopped (or started) is left out
+	if (!active.load() || begin < origin) {
+		return;
+	}
+	if (events.size() >= TRACE_MAX_EVENTS) {
+		dropped++;
+		return;
+	}
+
+	double ts = std::chrono::duration<double, std::micro>(begin - origin).count();
+	double dur = std::chrono::duration<double, std::micro>(end - begin).count();
+	events.push_back({ name, category, ts, dur, tid, args });
+}
+
+void TraceSpan::arg(const char* key, const std::string& value) {
+	if (recording) {
+		args += (args.empty() ? "\"" : ", \"") + std::string(key) + "\": " + json_string(value);
+	}
+}
+
+void TraceSpan::arg(const char* key, int64_t value) {
+	if (recording) {
+		args += (args.empty() ? "\"" : ", \"") + std::string(key) + "\": " + std::to_string(value);
+	}
+}
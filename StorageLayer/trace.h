@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static const size_t TRACE_MAX_EVENTS = 1000000; // later spans are dropped (and counted) to bound the memory of a forgotten trace
+
+using TraceClock = std::chrono::steady_clock;
+
+/**
+ * Process-wide collector of timed spans, written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+ * Spans are only recorded between start() and stop(), otherwise a span costs one atomic load.
+ */
+class Tracer {
+public:
+	static Tracer& instance();
+
+	// Starts collecting, the trace is written to path by stop(). False if a trace is already running.
+	bool start(const std::string& path);
+
+	// Writes the collected spans, returns false if nothing was running or the file can not be written
+	bool stop();
+
+	bool enabled() const {
+		return active.load(std::memory_order_relaxed);
+	}
+
+	// args is a JSON object body ("\"table\": \"t\"") or empty
+	void add(const char* name, const char* category, TraceClock::time_point begin, TraceClock::time_point end, const std::string& args);
+
+	const std::string& path() const {
+		return output_path;
+	}
+
+private:
+	struct Event {
+		const char* name;
+		const char* category;
+		double ts_us; // since start()
+		double dur_us;
+		uint32_t tid;
+		std::string args;
+	};
+
+	std::atomic<bool> active{ false };
+	std::mutex mutex;
+	std::vector<Event> events;
+	size_t dropped = 0;
+	std::string output_path;
+	TraceClock::time_point origin;
+
+	static uint32_t thread_number();
+};
+
+// Records a span from construction to destruction when tracing is on
+class TraceSpan {
+public:
+	TraceSpan(const char* name, const char* category)
+		: name(name), category(category), recording(Tracer::instance().enabled()) {
+		if (recording) {
+			begin = TraceClock::now();
+		}
+	}
+
+	~TraceSpan() {
+		if (recording) {
+			Tracer::instance().add(name, category, begin, TraceClock::now(), args);
+		}
+	}
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+	// Details shown for the span in the viewer, ignored while tracing is off
+	void arg(const char* key, const std::string& value);
+	void arg(const char* key, int64_t value);
+
+private:
+	const char* name;
+	const char* category;
+	bool recording;
+	TraceClock::time_point begin;
+	std::string args;
+};
@@ -0,0 +1,139 @@
+#include "undo_log.h"
+
+static bool is_visible(const RecordVersion& version, uint64_t snapshot) {
+	return !(version.timestamp & PENDING_VERSION) && version.timestamp <= snapshot;
+}
+
+// The last version that every snapshot from oldest on sees hides the ones written before it
+static void drop_seen_versions(std::vector<RecordVersion>& chain, uint64_t oldest) {
+	for (size_t i = chain.size(); i > 0; i--) {
+		if (is_visible(chain[i - 1], oldest)) {
+			chain.erase(chain.begin(), chain.begin() + i);
+			return;
+		}
+	}
+}
+
+void UndoLog::record(uint16_t page, uint16_t slot, std::optional<std::vector<uint8_t>> before) {
+	std::lock_guard<std::mutex> lock(mutex);
+	uint64_t ts = ++clock;
+
+	if (snapshots.empty()) {
+		// nobody reads the old record, unless a pending batch version of the slot is committed later
+		auto page_versions = versions.find(page);
+		if (page_versions == versions.end()) {
+			return;
+		}
+		auto chain = page_versions->second.find(slot);
+		if (chain == page_versions->second.end()) {
+			return;
+		}
+		drop_seen_versions(chain->second, ts - 1);
+		if (chain->second.empty()) {
+			page_versions->second.erase(chain);
+			if (page_versions->second.empty()) {
+				versions.erase(page_versions);
+			}
+			return;
+		}
+	}
+
+	versions[page][slot].push_back({ ts, std::move(before) });
+}
+
+uint64_t UndoLog::begin_batch() {
+	std::lock_guard<std::mutex> lock(mutex);
+	uint64_t batch = ++next_batch;
+	batches[batch];
+	return batch;
+}
+
+void UndoLog::record_pending(uint64_t batch, uint16_t page, uint16_t slot, std::optional<std::vector<uint8_t>> before) {
+	std::lock_guard<std::mutex> lock(mutex);
+	versions[page][slot].push_back({ PENDING_VERSION | batch, std::move(before) });
+	batches[batch].emplace_back(page, slot);
+}
+
+void UndoLog::commit(uint64_t batch) {
+	std::lock_guard<std::mutex> lock(mutex);
+	uint64_t ts = ++clock;
+
+	auto pending = batches.find(batch);
+	if (pending == batches.end()) {
+		return;
+	}
+
+	for (auto& [page, slot] : pending->second) {
+		for (auto& version : versions[page][slot]) {
+			if (version.timestamp == (PENDING_VERSION | batch)) {
+				version.timestamp = ts;
+			}
+		}
+	}
+	batches.erase(pending);
+	prune();
+}
+
+std::unordered_map<uint16_t, std::optional<std::vector<uint8_t>>> UndoLog::visible(uint16_t page, uint64_t snapshot) const {
+	std::unordered_map<uint16_t, std::optional<std::vector<uint8_t>>> records;
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto page_versions = versions.find(page);
+	if (page_versions == versions.end()) {
+		return records;
+	}
+
+	for (auto& [slot, chain] : page_versions->second) {
+		// the snapshot sees the record as the oldest write after its newest visible write found it
+		const RecordVersion* seen = nullptr;
+		for (size_t i = chain.size(); i > 0 && !is_visible(chain[i - 1], snapshot); i--) {
+			seen = &chain[i - 1];
+		}
+		if (seen) {
+			records.emplace(slot, seen->before);
+		}
+	}
+	return records;
+}
+
+size_t UndoLog::memory_bytes() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t bytes = 0;
+
+	for (auto& [page, slots] : versions) {
+		for (auto& [slot, chain] : slots) {
+			bytes += sizeof(slot) + sizeof(chain) + chain.capacity() * sizeof(RecordVersion);
+			for (auto& version : chain) {
+				bytes += version.before ? version.before->capacity() : 0;
+			}
+		}
+	}
+	for (auto& [batch, pending] : batches) {
+		bytes += sizeof(batch) + sizeof(pending) + pending.capacity() * sizeof(pending[0]);
+	}
+	return bytes;
+}
+
+uint64_t UndoLog::begin_snapshot() {
+	std::lock_guard<std::mutex> lock(mutex);
+	snapshots.insert(clock);
+	return clock;
+}
+
+void UndoLog::end_snapshot(uint64_t snapshot) {
+	std::lock_guard<std::mutex> lock(mutex);
+	snapshots.erase(snapshots.find(snapshot));
+	prune();
+}
+
+void UndoLog::prune() {
+	uint64_t oldest = snapshots.empty() ? clock : *snapshots.begin();
+
+	for (auto page = versions.begin(); page != versions.end();) {
+		for (auto chain = page->second.begin(); chain != page->second.end();) {
+			drop_seen_versions(chain->second, oldest);
+			chain = chain->second.empty() ? page->second.erase(chain) : std::next(chain);
+		}
+		page = page->second.empty() ? versions.erase(page) : std::next(page);
+	}
+}
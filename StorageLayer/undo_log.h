@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Timestamp of a version whose batch write has not committed yet, the low bits hold the batch number
+static const uint64_t PENDING_VERSION = 1ull << 63;
+
+// A record as it was before one write, nullopt when the write inserted it
+struct RecordVersion {
+	uint64_t timestamp; // of the write
+	std::optional<std::vector<uint8_t>> before;
+};
+
+/**
+ * Before images of the recent writes of one table, keyed by page and slot, so a scan reads the table as of its
+ * snapshot while writers change the pages. Every write takes the next timestamp of the table clock and a snapshot
+ * sees the writes up to the clock value it started at. Versions are dropped once no snapshot can need them.
+ * A batch write records its versions as pending and commits them with one timestamp: snapshots see all of it or nothing.
+ */
+class UndoLog {
+public:
+	// Snapshot of the table, open until it goes out of scope
+	class Snapshot {
+	public:
+		explicit Snapshot(UndoLog& log) : log(log), ts(log.begin_snapshot()) {
+		}
+		~Snapshot() {
+			log.end_snapshot(ts);
+		}
+
+		Snapshot(const Snapshot&) = delete;
+		Snapshot& operator=(const Snapshot&) = delete;
+
+		uint64_t timestamp() const {
+			return ts;
+		}
+
+	private:
+		UndoLog& log;
+		uint64_t ts;
+	};
+
+	// Timestamp a single record write. The before image is only kept when an open snapshot or an earlier version of
+	// the slot needs it. The caller holds the page latch exclusively until the page is written.
+	void record(uint16_t page, uint16_t slot, std::optional<std::vector<uint8_t>> before);
+
+	// Writes of a batch stay invisible to every snapshot until commit(). The caller holds the page latch exclusively.
+	uint64_t begin_batch();
+	void record_pending(uint64_t batch, uint16_t page, uint16_t slot, std::optional<std::vector<uint8_t>> before);
+	void commit(uint64_t batch);
+
+	// Records of the page that the snapshot sees differently from the page content: slot to the record the snapshot
+	// sees, nullopt for records it does not see. The caller holds the page latch.
+	std::unordered_map<uint16_t, std::optional<std::vector<uint8_t>>> visible(uint16_t page, uint64_t snapshot) const;
+
+	size_t memory_bytes() const;
+
+private:
+	uint64_t begin_snapshot();
+	void end_snapshot(uint64_t snapshot);
+
+	// Drop the versions every open and future snapshot sees past, the caller holds the mutex
+	void prune();
+
+	mutable std::mutex mutex;
+	uint64_t clock = 0;
+	uint64_t next_batch = 0;
+	std::multiset<uint64_t> snapshots;
+	std::unordered_map<uint64_t, std::vector<std::pair<uint16_t, uint16_t>>> batches; // page and slot of the pending versions
+	std::unordered_map<uint16_t, std::unordered_map<uint16_t, std::vector<RecordVersion>>> versions; // page, slot, versions in write order
+};